@@ -0,0 +1,385 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+#include "cxml_benchutil.h"
+
+/* Throughput/latency/memory benchmark of cxml on synthetic corpora.
+ * Built and run by 'make bench', which links it with -Wl,--wrap for
+ * malloc/calloc/realloc so that allocations of the library are counted.
+ * Every result is a line of JSON on stdout, one per corpus and document
+ * size, then one for the process:
+ *   {"corpus":..,"doc":"pkt"|"bulk","bytes":..,"nodes":..,
+ *    "dec_mbps":..,"enc_mbps":..,"find_ns":..,"attr_ns":..,
+ *    "dec_allocs":..,"dec_reuse_allocs":..,"enc_allocs":..}
+ *   {"peak_rss_kb":..}
+ * Usage: cxml_bench [-s bulkBytes] [-t msPerRound] [-c corpus]
+ * */
+
+/*documents cx_DecPkt/cx_EncPkt can take, and big ones for cx_DecBuf*/
+#define BENCH_PKT_SZ   (CX_MAX_ENC_STR_SZ - 128)
+#define BENCH_BULK_SZ  (4 * 1024 * 1024)
+#define BENCH_ROUND_MS 100
+#define BENCH_ROUNDS   3
+
+static uint64_t benchAllocs;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t n, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+void *__wrap_malloc (size_t size)
+{
+	__atomic_add_fetch (&benchAllocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc (size);
+}
+
+void *__wrap_calloc (size_t n, size_t size)
+{
+	__atomic_add_fetch (&benchAllocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc (n, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+	__atomic_add_fetch (&benchAllocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc (ptr, size);
+}
+
+/*xorshift, so that corpora are the same from run to run*/
+#define BENCH_SEED 2463534242u
+static uint32_t rngState = BENCH_SEED;
+
+static uint32_t rnd (uint32_t n)
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState % n;
+}
+
+static const char *words[] = {
+	"status", "light", "sensor", "value", "alpha", "node", "packet", "temp",
+	"config", "event", "zone", "level", "device", "mode", "on", "off",
+};
+#define NWORDS (sizeof (words) / sizeof (words[0]))
+
+/*Output of a generator, it never writes beyond cap bytes*/
+typedef struct bench_gen_s {
+	char                *buf;
+	size_t              len;
+	size_t              cap;
+} bench_gen_t;
+
+static void put (bench_gen_t *g, const char *fmt, ...) \
+	__attribute__((format (printf, 2, 3)));
+
+static void put (bench_gen_t *g, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start (ap, fmt);
+	n = vsnprintf (g->buf + g->len, g->cap - g->len, fmt, ap);
+	va_end (ap);
+	if ((n > 0) && ((size_t)n < (g->cap - g->len))) {
+		g->len += n;
+	}
+}
+
+/*Bytes kept free by items for closing tags after them*/
+#define BENCH_RESERVE 96
+
+/*Room left for one more item of upto itemSz bytes and the closing tags*/
+#define ROOM(g, itemSz) (((g)->len + (itemSz) + BENCH_RESERVE) < (g)->cap)
+
+/*Upto n words, as many as fit*/
+static void putWords (bench_gen_t *g, uint32_t n)
+{
+	uint32_t fit = ROOM (g, 0) ? \
+		(uint32_t)((g->cap - g->len - BENCH_RESERVE) / 8) : 0;
+
+	n = (n > fit) ? fit : n;
+	while (n--) {
+		put (g, "%s%s", words[rnd (NWORDS)], n ? " " : "");
+	}
+}
+
+static void genShallowWide (bench_gen_t *g)
+{
+	uint32_t i = 0;
+
+	put (g, "<?xml version=\"1.0\"?><records>");
+	while (ROOM (g, 96)) {
+		put (g, "<rec id=\"%u\"><key>%s</key><val>%u</val></rec>", \
+				i++, words[rnd (NWORDS)], rnd (100000));
+	}
+	put (g, "</records>");
+}
+
+static void genDeepNested (bench_gen_t *g)
+{
+	uint32_t d, depth;
+
+	put (g, "<?xml version=\"1.0\"?><tree>");
+	while (ROOM (g, 64 * 12 + 16)) {
+		depth = 8 + rnd (56);
+		for (d = 0; d < depth; d++) {
+			put (g, "<n%u>", d);
+		}
+		put (g, "<leaf v=\"%u\"/>", rnd (1000));
+		while (d--) {
+			put (g, "</n%u>", d);
+		}
+	}
+	put (g, "</tree>");
+}
+
+static void genAttrHeavy (bench_gen_t *g)
+{
+	uint32_t a, n;
+
+	put (g, "<?xml version=\"1.0\"?><devices>");
+	while (ROOM (g, 24 * 32)) {
+		put (g, "<dev");
+		for (a = 0, n = 8 + rnd (16); a < n; a++) {
+			put (g, " a%u=\"%s%u\"", a, words[rnd (NWORDS)], rnd (1000));
+		}
+		put (g, "/>");
+	}
+	put (g, "</devices>");
+}
+
+static void genContentHeavy (bench_gen_t *g)
+{
+	put (g, "<?xml version=\"1.0\"?><doc>");
+	while (ROOM (g, 64)) {
+		put (g, "<p>");
+		putWords (g, 32 + rnd (480));
+		put (g, "</p>");
+	}
+	put (g, "</doc>");
+}
+
+static void genCdataComment (bench_gen_t *g)
+{
+	put (g, "<?xml version=\"1.0\"?><log>");
+	while (ROOM (g, 128)) {
+		put (g, "<!-- ");
+		putWords (g, 4 + rnd (60));
+		put (g, " --><entry><![CDATA[<raw>");
+		putWords (g, 4 + rnd (120));
+		put (g, "</raw>]]></entry>");
+	}
+	put (g, "</log>");
+}
+
+/**
+ * A corpus: how its documents are generated and what is looked up in them
+ * findTags - tags cx_FindNodeWithTag is timed with, one of them absent
+ * attrTag, attrName - attr cx_GetAttrValue is timed with
+ */
+typedef struct bench_corpus_s {
+	const char          *name;
+	void                (*gen) (bench_gen_t *g);
+	const char          *findTags[4];
+	const char          *attrTag;
+	const char          *attrName;
+} bench_corpus_t;
+
+static const bench_corpus_t corpora[] = {
+	{ "shallow-wide", genShallowWide, {"rec", "val", "records", "absent"}, \
+		"rec", "id" },
+	{ "deep-nested", genDeepNested, {"n7", "n40", "leaf", "absent"}, \
+		"leaf", "v" },
+	{ "attr-heavy", genAttrHeavy, {"dev", "devices", "dev", "absent"}, \
+		"dev", "a7" },
+	{ "content-heavy", genContentHeavy, {"p", "doc", "p", "absent"}, \
+		"doc", "absent" },
+	{ "cdata-comment-heavy", genCdataComment, {"entry", "log", "entry", \
+		"absent"}, "log", "absent" },
+};
+#define NCORPORA (sizeof (corpora) / sizeof (corpora[0]))
+
+/*Runs of something timed, best of a few rounds of atleast roundMs each*/
+static uint32_t roundMs = BENCH_ROUND_MS;
+
+#define BENCH_BEST(bestSec, reps, body) \
+	do { \
+		double _t0, _t; \
+		uint32_t _r; \
+		bestSec = 1e30; \
+		for (_r = 0; _r < BENCH_ROUNDS; _r++) { \
+			reps = 0; \
+			_t0 = nowSec (); \
+			do { \
+				body; \
+				reps++; \
+			} while ((_t = nowSec () - _t0) < (roundMs / 1e3)); \
+			if ((_t / reps) < bestSec) { \
+				bestSec = _t / reps; \
+			} \
+		} \
+	} while (0)
+
+static cx_status_t decode (void **cookie, char *buf, uint32_t len, int isPkt, \
+		uint32_t flags)
+{
+	return isPkt ? _cx_DecPkt (cookie, buf, "bench", flags) : \
+		_cx_DecBuf (cookie, buf, len, "bench", flags, 1);
+}
+
+static int benchDoc (const bench_corpus_t *c, char *buf, uint32_t len, \
+		int isPkt)
+{
+	cx_status_t xStatus;
+	void *dec = NULL, *enc = NULL, *tmp = NULL;
+	cx_node_t **handle;
+	char *xml, *decXml, attrValue[CX_MAX_DEC_STR_SZ + 1];
+	double decSec, encSec, findSec, attrSec;
+	uint64_t reps, decAllocs, reuseAllocs, encAllocs, i;
+	uint32_t nodes;
+	uint64_t encLen;
+
+	/*fresh session, then one reused for the timed runs*/
+	benchAllocs = 0;
+	xStatus = decode (&tmp, buf, len, isPkt, CXDEC_COPY);
+	decAllocs = benchAllocs;
+	cx_DestroySession (tmp);
+	cx_func_rfail (decode (&dec, buf, len, isPkt, CXDEC_COPY));
+	benchAllocs = 0;
+	cx_func_rfail (decode (&dec, buf, len, isPkt, CXDEC_REUSE));
+	reuseAllocs = benchAllocs;
+	nodes = ((cx_cookie_t *)dec)->nodes.nNodes - 1;
+
+	BENCH_BEST (decSec, reps, \
+			xStatus |= decode (&dec, buf, len, isPkt, CXDEC_REUSE));
+	cx_func_rfail (xStatus);
+
+	/*encoder tree with the same nodes*/
+	cx_func_rfail (cx_CreateSession (&enc, "bench", NULL, 0));
+	_cx_calloc (handle, ((cx_cookie_t *)dec)->nodes.nNodes * \
+			sizeof (cx_node_t *));
+	cx_alloc_rfail (handle);
+	xStatus = copyTree ((cx_cookie_t *)dec, enc, handle);
+	free (handle);
+	cx_func_rfail (xStatus);
+	encLen = cx_EncLength (enc);
+	benchAllocs = 0;
+	cx_func_rfail (isPkt ? cx_EncPkt (enc, &xml) : cx_EncBuf (enc, &xml, 1));
+	encAllocs = benchAllocs;
+	BENCH_BEST (encSec, reps, xStatus |= (isPkt ? cx_EncPkt (enc, &xml) : \
+				cx_EncBuf (enc, &xml, 1)));
+	cx_func_rfail (xStatus);
+
+	/*decoded tree encodes straight to the same string*/
+	cx_func_rfail (isPkt ? cx_EncPkt (dec, &decXml) : \
+			cx_EncBuf (dec, &decXml, 1));
+	cx_rfail ((cx_EncLength (dec) != encLen) || \
+			memcmp (decXml, xml, encLen + 1), CX_FAILURE);
+#if CX_USING_LAZY
+	/*so does a lazy one, built in part by a lookup first*/
+	tmp = NULL;
+	cx_func_rfail (decode (&tmp, buf, len, isPkt, \
+				CXDEC_ZEROCOPY | CXDEC_LAZY));
+	(void)cx_FindNodeWithTag (tmp, (char *)c->findTags[0]);
+	xStatus = isPkt ? cx_EncPkt (tmp, &decXml) : cx_EncBuf (tmp, &decXml, 1);
+	if ((xStatus == CX_SUCCESS) && memcmp (decXml, xml, encLen + 1)) {
+		xStatus = CX_FAILURE;
+	}
+	cx_DestroySession (tmp);
+	cx_func_rfail (xStatus);
+#endif
+
+	/*lookups, tag index is built by first of them*/
+	cx_FindNodeWithTag (dec, (char *)c->findTags[0]);
+	i = 0;
+	BENCH_BEST (findSec, reps, \
+			(void)cx_FindNodeWithTag (dec, (char *)c->findTags[i++ & 3]));
+	BENCH_BEST (attrSec, reps, \
+			(void)cx_GetAttrValue (dec, c->attrTag, c->attrName, attrValue));
+
+	printf ("{\"corpus\":\"%s\",\"doc\":\"%s\",\"bytes\":%u,\"nodes\":%u,"
+			"\"dec_mbps\":%.1f,\"enc_mbps\":%.1f,\"find_ns\":%.1f,"
+			"\"attr_ns\":%.1f,\"dec_allocs\":%llu,\"dec_reuse_allocs\":%llu,"
+			"\"enc_allocs\":%llu}\n", c->name, isPkt ? "pkt" : "bulk", len, \
+			nodes, len / decSec / 1e6, encLen / encSec / 1e6, findSec * 1e9, \
+			attrSec * 1e9, (unsigned long long)decAllocs, \
+			(unsigned long long)reuseAllocs, (unsigned long long)encAllocs);
+	fflush (stdout);
+
+	cx_DestroySession (enc);
+	cx_DestroySession (dec);
+
+	return CX_SUCCESS;
+}
+
+int main (int argc, char *argv[])
+{
+	cx_status_t xStatus;
+	const char *only = NULL;
+	size_t bulkSz = BENCH_BULK_SZ;
+	bench_gen_t g;
+	struct rusage ru;
+	uint32_t c;
+	int opt, ret = 0;
+
+	while ((opt = getopt (argc, argv, "s:t:c:")) != -1) {
+		switch (opt) {
+			case 's': bulkSz = strtoul (optarg, NULL, 0); break;
+			case 't': roundMs = strtoul (optarg, NULL, 0); break;
+			case 'c': only = optarg; break;
+			default:
+				fprintf (stderr, "usage: %s [-s bulkBytes] [-t msPerRound] "
+						"[-c corpus]\n", argv[0]);
+				return 1;
+		}
+	}
+	if ((bulkSz < BENCH_PKT_SZ) || (bulkSz > UINT32_MAX)) {
+		fprintf (stderr, "bulk size must be %u..%u bytes\n", \
+				BENCH_PKT_SZ, UINT32_MAX);
+		return 1;
+	}
+
+	g.buf = malloc (bulkSz + 1);
+	if (!g.buf) {
+		return 1;
+	}
+	for (c = 0; c < NCORPORA; c++) {
+		if (only && strcmp (only, corpora[c].name)) {
+			continue;
+		}
+		rngState = BENCH_SEED;
+		g.len = 0;
+		g.cap = BENCH_PKT_SZ + 1;
+		corpora[c].gen (&g);
+		if (CX_SUCCESS != (xStatus = benchDoc (&corpora[c], g.buf, \
+						(uint32_t)g.len, 1))) {
+			fprintf (stderr, "%s pkt: %s\n", corpora[c].name, \
+					cx_strerr (xStatus));
+			ret = 1;
+		}
+		g.len = 0;
+		g.cap = bulkSz + 1;
+		corpora[c].gen (&g);
+		if (CX_SUCCESS != (xStatus = benchDoc (&corpora[c], g.buf, \
+						(uint32_t)g.len, 0))) {
+			fprintf (stderr, "%s bulk: %s\n", corpora[c].name, \
+					cx_strerr (xStatus));
+			ret = 1;
+		}
+	}
+	free (g.buf);
+
+	getrusage (RUSAGE_SELF, &ru);
+	printf ("{\"peak_rss_kb\":%ld}\n", ru.ru_maxrss);
+
+	return ret;
+}
@@ -0,0 +1,73 @@
+#ifndef __CXML_BENCHUTIL_H
+#define __CXML_BENCHUTIL_H
+
+#include <time.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+
+/*Helpers shared by benchmark and soak drivers*/
+
+static inline double nowSec (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static inline uint64_t nowNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @func   : copyTree
+ * @brief  : build an encoder tree just like a decoded one, with handles
+ * @called : to get trees to encode out of decoded documents
+ * @input  : cx_cookie_t *dec - decoded session, in copy mode
+ *           void *enc - empty encoder session
+ *           cx_node_t **handle - room for a handle per node of dec
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static inline cx_status_t copyTree (cx_cookie_t *dec, void *enc, \
+		cx_node_t **handle)
+{
+	cx_status_t xStatus = CX_SUCCESS;
+	cx_node_t *src, *at;
+	cxn_attr_t *attr;
+	uint32_t i;
+
+	for (i = 1; (i < dec->nodes.nNodes) && (xStatus == CX_SUCCESS); i++) {
+		src = _cx_Node (dec, i);
+		if (src->parent) {
+			at = handle[src->parent];
+			xStatus = _cx_BuildNode (enc, src->tagField, src->nodeType, at, \
+					CXADD_CHILD, &handle[i]);
+		} else if (i == 1) {
+			xStatus = _cx_BuildNode (enc, src->tagField, src->nodeType, NULL, \
+					CXADD_FIRST, &handle[i]);
+		} else {
+			at = handle[1];
+			while (at->next) {
+				at = _cx_Node (enc, at->next);
+			}
+			xStatus = _cx_BuildNode (enc, src->tagField, src->nodeType, at, \
+					CXADD_NEXT, &handle[i]);
+		}
+		for (attr = src->attrList; attr && (xStatus == CX_SUCCESS); \
+				attr = attr->next) {
+			xStatus = cx_BuildAttr_STR (enc, handle[i], attr->attrName, \
+					attr->attrValue);
+		}
+	}
+
+	return xStatus;
+}
+
+#endif /*__CXML_BENCHUTIL_H*/
@@ -0,0 +1,484 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+#include "cxml_benchutil.h"
+
+/* Soak driver: threads replay a packet mix through the decoder, attr
+ * lookups and the encoder for a given time, to catch leaks, memory growth
+ * and latency cliffs that a short benchmark doesn't show.
+ * Every -i ms a sample of process memory is printed, at the end latency
+ * histogram of each operation; all as lines of JSON on stdout:
+ *   {"t_s":..,"ops":..,"rss_kb":..,"heap_kb":..,"heap_free_kb":..,
+ *    "mmap_kb":..,"frag":..}
+ *   {"op":..,"count":..,"errors":..,"p50_ns":..,"p90_ns":..,"p99_ns":..,
+ *    "p999_ns":..,"max_ns":..,"hist":[[upto_ns,count],..]}
+ *   {"rss_start_kb":..,"rss_end_kb":..,"rss_max_kb":..}
+ * frag is the share of heap malloc holds but which is free, growing
+ * with it while rss is flat is fragmentation, both growing is a leak.
+ * Usage: cxml_soak [-d seconds] [-j threads] [-i ms] [-f packetFile]
+ * packetFile has a packet per line, a generated mix is used without it
+ * */
+
+#define SOAK_DURATION_S 10
+#define SOAK_INTERVAL_MS 1000
+#define SOAK_NPKTS 1024
+#define SOAK_MAX_THREADS 256
+/*every SOAK_BATCH_EVERY iterations a thread decodes SOAK_BATCH_SZ packets
+ *with cx_DecBatch, on a pool as wide as it picks at random each time*/
+#define SOAK_BATCH_EVERY 16
+#define SOAK_BATCH_SZ 16
+
+/*Operations timed, each has a histogram*/
+enum {
+	OP_DEC,         /*cx_DecPkt into a new session*/
+	OP_DEC_REUSE,   /*cx_DecPktReuse into the thread's session*/
+	OP_ATTR,        /*cx_GetAttrValue on decoded tree*/
+	OP_ENC,         /*cx_EncPkt of the thread's decoded session*/
+	OP_FREE,        /*cx_DestroySession of the new session*/
+	OP_BATCH,       /*cx_DecBatch of a few packets, pool width varying*/
+	OP_MAX,
+};
+static const char *opName[OP_MAX] = {
+	[OP_DEC] = "dec", [OP_DEC_REUSE] = "dec_reuse", [OP_ATTR] = "attr",
+	[OP_ENC] = "enc", [OP_FREE] = "free", [OP_BATCH] = "batch",
+};
+
+/* Log-linear histogram: values below 2^SUB_BITS ns have a bucket each,
+ * others 2^SUB_BITS buckets per power of 2, i.e. within 12.5% */
+#define SUB_BITS 3
+#define NSUB (1u << SUB_BITS)
+#define NBUCKETS ((64 - SUB_BITS) * NSUB)
+
+static inline uint32_t bucketOf (uint64_t ns)
+{
+	uint32_t msb;
+
+	if (ns < NSUB) {
+		return (uint32_t)ns;
+	}
+	msb = 63 - __builtin_clzll (ns);
+	return ((msb - SUB_BITS + 1) * NSUB) + \
+		(uint32_t)((ns >> (msb - SUB_BITS)) & (NSUB - 1));
+}
+
+/*Largest value falling in a bucket*/
+static inline uint64_t bucketUpto (uint32_t b)
+{
+	uint32_t msb = (b / NSUB) + SUB_BITS - 1;
+
+	if (b < NSUB) {
+		return b;
+	}
+	return (((uint64_t)(NSUB + (b % NSUB)) + 1) << (msb - SUB_BITS)) - 1;
+}
+
+typedef struct soak_hist_s {
+	uint64_t            count[NBUCKETS];
+	uint64_t            n;
+	uint64_t            errors;
+	uint64_t            max;
+} soak_hist_t;
+
+/**
+ * A packet of the mix
+ * xml - the packet, NULL terminated
+ * attrTag, attrName - an attr it has, for cx_GetAttrValue; NULL if none
+ */
+typedef struct soak_pkt_s {
+	char                *xml;
+	char                *attrTag;
+	char                *attrName;
+} soak_pkt_t;
+
+static soak_pkt_t *pkts;
+static uint32_t nPkts;
+
+/**
+ * State of a soak thread, histograms are its own till it is joined
+ * ops - operations done, read by sampler as they go
+ */
+typedef struct soak_thread_s {
+	pthread_t           tid;
+	uint32_t            seed;
+	uint64_t            ops;
+	soak_hist_t         hist[OP_MAX];
+} soak_thread_t;
+
+static int soakStop;
+
+static void record (soak_thread_t *th, uint32_t op, uint64_t t0, \
+		cx_status_t xStatus)
+{
+	soak_hist_t *h = &th->hist[op];
+	uint64_t ns = nowNs () - t0;
+
+	h->count[bucketOf (ns)]++;
+	h->n++;
+	h->errors += (xStatus != CX_SUCCESS);
+	if (ns > h->max) {
+		h->max = ns;
+	}
+	__atomic_store_n (&th->ops, th->ops + 1, __ATOMIC_RELAXED);
+}
+
+static uint32_t rnd (uint32_t *state, uint32_t n)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state % n;
+}
+
+static void *soakThread (void *arg)
+{
+	soak_thread_t *th = (soak_thread_t *)arg;
+	cx_status_t xStatus;
+	void *dec, *reuse = NULL;
+	char attrValue[CX_MAX_DEC_STR_SZ + 1], *xml;
+	soak_pkt_t *pkt;
+	uint64_t t0;
+#if CX_USING_POOL
+	void *batch[SOAK_BATCH_SZ] = { NULL };
+	char *in[SOAK_BATCH_SZ];
+	uint32_t i, iter = 0;
+#endif
+
+	while (!__atomic_load_n (&soakStop, __ATOMIC_RELAXED)) {
+#if CX_USING_POOL
+		/*runs of other threads, narrower or wider, go on the same pool*/
+		if (!(++iter % SOAK_BATCH_EVERY)) {
+			for (i = 0; i < SOAK_BATCH_SZ; i++) {
+				in[i] = pkts[rnd (&th->seed, nPkts)].xml;
+			}
+			t0 = nowNs ();
+			xStatus = cx_DecBatch (in, SOAK_BATCH_SZ, batch, \
+					1 + rnd (&th->seed, SOAK_BATCH_SZ));
+			record (th, OP_BATCH, t0, xStatus);
+		}
+#endif
+		pkt = &pkts[rnd (&th->seed, nPkts)];
+
+		dec = NULL;
+		t0 = nowNs ();
+		xStatus = cx_DecPkt (&dec, pkt->xml, "soak");
+		record (th, OP_DEC, t0, xStatus);
+		if (dec) {
+			t0 = nowNs ();
+			cx_DestroySession (dec);
+			record (th, OP_FREE, t0, CX_SUCCESS);
+		}
+
+		t0 = nowNs ();
+		xStatus = cx_DecPktReuse (&reuse, pkt->xml, "soak");
+		record (th, OP_DEC_REUSE, t0, xStatus);
+		if (xStatus != CX_SUCCESS) {
+			continue;
+		}
+
+		if (pkt->attrTag) {
+			t0 = nowNs ();
+			xStatus = cx_GetAttrValue (reuse, pkt->attrTag, pkt->attrName, \
+					attrValue);
+			record (th, OP_ATTR, t0, xStatus);
+		}
+
+		t0 = nowNs ();
+		xStatus = cx_EncPkt (reuse, &xml);
+		record (th, OP_ENC, t0, xStatus);
+	}
+	cx_DestroySession (reuse);
+#if CX_USING_POOL
+	for (i = 0; i < SOAK_BATCH_SZ; i++) {
+		cx_DestroySession (batch[i]);
+	}
+#endif
+
+	return NULL;
+}
+
+static const char *mixWords[] = {
+	"kitchen", "hall", "porch", "garage", "on", "off", "dim", "auto",
+};
+
+/*A packet like ones devices send, about 1 in 64 of them broken*/
+static char *genPkt (uint32_t *seed)
+{
+	char buf[CX_MAX_ENC_STR_SZ];
+	size_t len = 0, cap = sizeof (buf) - 64;
+	uint32_t i, n, kind = rnd (seed, 4);
+
+#define PUT(...) \
+	do { \
+		int _n = snprintf (buf + len, sizeof (buf) - len, __VA_ARGS__); \
+		len += ((_n > 0) && ((size_t)_n < (sizeof (buf) - len))) ? _n : 0; \
+	} while (0)
+
+	PUT ("<?xml version=\"1.0\"?>");
+	if (kind == 0) {
+		PUT ("<event id=\"%u\" type=\"%s\"><src dev=\"d%u\" zone=\"%s\"/>" \
+				"<time>%u</time></event>", rnd (seed, 100000), \
+				mixWords[rnd (seed, 8)], rnd (seed, 64), \
+				mixWords[rnd (seed, 4)], rnd (seed, 86400));
+	} else if (kind == 1) {
+		PUT ("<status dev=\"d%u\">", rnd (seed, 64));
+		for (i = 0, n = 1 + rnd (seed, 24); (i < n) && (len < cap); i++) {
+			PUT ("<light id=\"%u\" level=\"%u\" mode=\"%s\"/>", i, \
+					rnd (seed, 256), mixWords[4 + rnd (seed, 4)]);
+		}
+		PUT ("<temp unit=\"C\">%u</temp></status>", rnd (seed, 40));
+	} else if (kind == 2) {
+		PUT ("<config ver=\"%u\"><!-- pushed by controller -->", \
+				rnd (seed, 10));
+		for (i = 0, n = 1 + rnd (seed, 8); (i < n) && (len < cap); i++) {
+			PUT ("<rule zone=\"%s\"><when>%u</when><![CDATA[on > %u]]>" \
+					"</rule>", mixWords[rnd (seed, 4)], rnd (seed, 1440), \
+					rnd (seed, 100));
+		}
+		PUT ("</config>");
+	} else {
+		PUT ("<ack seq=\"%u\"/>", rnd (seed, 1u << 20));
+	}
+#undef PUT
+
+	if (!rnd (seed, 64)) {
+		len = 1 + rnd (seed, (uint32_t)len); /*cut short*/
+	}
+	buf[len] = '\0';
+
+	return strdup (buf);
+}
+
+/*An attr of first element having one, to be looked up in the packet*/
+static void findAttr (soak_pkt_t *pkt)
+{
+	cx_cookie_t *cookie = NULL;
+	cx_node_t *node;
+	uint32_t i;
+
+	if (CX_SUCCESS != cx_DecPkt ((void **)&cookie, pkt->xml, "probe")) {
+		return;
+	}
+	for (i = 1; i < cookie->nodes.nNodes; i++) {
+		node = _cx_Node (cookie, i);
+		if (node->attrList) {
+			pkt->attrTag = strdup (node->tagField);
+			pkt->attrName = strdup (node->attrList->attrName);
+			break;
+		}
+	}
+	cx_DestroySession (cookie);
+}
+
+static int loadPkts (const char *path)
+{
+	char line[CX_MAX_DEC_STR_SZ + 2];
+	uint32_t seed = 2463534242u, cap = SOAK_NPKTS;
+	FILE *fp;
+	size_t len;
+
+	pkts = calloc (cap, sizeof (soak_pkt_t));
+	if (!pkts) {
+		return -1;
+	}
+	if (!path) {
+		for (nPkts = 0; nPkts < cap; nPkts++) {
+			pkts[nPkts].xml = genPkt (&seed);
+			findAttr (&pkts[nPkts]);
+		}
+		return 0;
+	}
+
+	fp = fopen (path, "r");
+	if (!fp) {
+		perror (path);
+		return -1;
+	}
+	while (fgets (line, sizeof (line), fp)) {
+		len = strlen (line);
+		if (len && (line[len - 1] != '\n') && !feof (fp)) {
+			/*longer than any packet can be, skip rest of it*/
+			while (fgets (line, sizeof (line), fp) && \
+					(line[strlen (line) - 1] != '\n'));
+			continue;
+		}
+		line[strcspn (line, "\r\n")] = '\0';
+		if (!line[0]) {
+			continue;
+		}
+		if (nPkts == cap) {
+			soak_pkt_t *more = realloc (pkts, 2 * cap * sizeof (soak_pkt_t));
+			if (!more) {
+				break;
+			}
+			memset (more + cap, 0, cap * sizeof (soak_pkt_t));
+			pkts = more;
+			cap *= 2;
+		}
+		pkts[nPkts].xml = strdup (line);
+		findAttr (&pkts[nPkts++]);
+	}
+	fclose (fp);
+
+	return nPkts ? 0 : -1;
+}
+
+static long rssKb (void)
+{
+	long pages = 0;
+	FILE *fp = fopen ("/proc/self/statm", "r");
+
+	if (fp) {
+		if (fscanf (fp, "%*s %ld", &pages) != 1) {
+			pages = 0;
+		}
+		fclose (fp);
+	}
+	return pages * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void printHist (uint32_t op, soak_hist_t *h)
+{
+	static const double pct[] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t at[4], seen = 0;
+	uint32_t b, p = 0;
+	int first = 1;
+
+	for (b = 0; b < NBUCKETS; b++) {
+		seen += h->count[b];
+		while ((p < 4) && h->n && (seen >= (uint64_t)(pct[p] * h->n))) {
+			at[p++] = bucketUpto (b);
+		}
+	}
+	while (p < 4) {
+		at[p++] = 0;
+	}
+
+	printf ("{\"op\":\"%s\",\"count\":%llu,\"errors\":%llu,\"p50_ns\":%llu,"
+			"\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,"
+			"\"hist\":[", opName[op], (unsigned long long)h->n, \
+			(unsigned long long)h->errors, (unsigned long long)at[0], \
+			(unsigned long long)at[1], (unsigned long long)at[2], \
+			(unsigned long long)at[3], (unsigned long long)h->max);
+	for (b = 0; b < NBUCKETS; b++) {
+		if (h->count[b]) {
+			printf ("%s[%llu,%llu]", first ? "" : ",", \
+					(unsigned long long)bucketUpto (b), \
+					(unsigned long long)h->count[b]);
+			first = 0;
+		}
+	}
+	printf ("]}\n");
+}
+
+int main (int argc, char *argv[])
+{
+	const char *path = NULL;
+	uint32_t duration = SOAK_DURATION_S, intervalMs = SOAK_INTERVAL_MS;
+	uint32_t nThreads = 0, t, op, b;
+	soak_thread_t *th;
+	soak_hist_t *sum;
+	struct mallinfo2 mi;
+	long rss, rssStart, rssMax;
+	double start, now;
+	uint64_t ops;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "d:j:i:f:")) != -1) {
+		switch (opt) {
+			case 'd': duration = strtoul (optarg, NULL, 0); break;
+			case 'j': nThreads = strtoul (optarg, NULL, 0); break;
+			case 'i': intervalMs = strtoul (optarg, NULL, 0); break;
+			case 'f': path = optarg; break;
+			default:
+				fprintf (stderr, "usage: %s [-d seconds] [-j threads] "
+						"[-i ms] [-f packetFile]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (!nThreads) {
+		nThreads = (uint32_t)sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	if (!nThreads || (nThreads > SOAK_MAX_THREADS) || !intervalMs) {
+		fprintf (stderr, "threads must be 1..%u, interval non-zero\n", \
+				SOAK_MAX_THREADS);
+		return 1;
+	}
+	if (loadPkts (path)) {
+		fprintf (stderr, "no packets to replay\n");
+		return 1;
+	}
+
+	th = calloc (nThreads, sizeof (soak_thread_t));
+	sum = calloc (OP_MAX, sizeof (soak_hist_t));
+	if (!th || !sum) {
+		return 1;
+	}
+	rssStart = rssMax = rssKb ();
+	for (t = 0; t < nThreads; t++) {
+		th[t].seed = 2463534242u + (t * 7919);
+		if (pthread_create (&th[t].tid, NULL, soakThread, &th[t])) {
+			nThreads = t;
+			break;
+		}
+	}
+
+	start = nowSec ();
+	do {
+		usleep (intervalMs * 1000);
+		now = nowSec ();
+		for (t = 0, ops = 0; t < nThreads; t++) {
+			ops += __atomic_load_n (&th[t].ops, __ATOMIC_RELAXED);
+		}
+		rss = rssKb ();
+		rssMax = (rss > rssMax) ? rss : rssMax;
+		mi = mallinfo2 ();
+		printf ("{\"t_s\":%.1f,\"ops\":%llu,\"rss_kb\":%ld,\"heap_kb\":%zu,"
+				"\"heap_free_kb\":%zu,\"mmap_kb\":%zu,\"frag\":%.3f}\n", \
+				now - start, (unsigned long long)ops, rss, mi.arena / 1024, \
+				mi.fordblks / 1024, mi.hblkhd / 1024, \
+				mi.arena ? ((double)mi.fordblks / mi.arena) : 0.0);
+		fflush (stdout);
+	} while ((now - start) < duration);
+
+	__atomic_store_n (&soakStop, 1, __ATOMIC_RELAXED);
+	for (t = 0; t < nThreads; t++) {
+		pthread_join (th[t].tid, NULL);
+		for (op = 0; op < OP_MAX; op++) {
+			for (b = 0; b < NBUCKETS; b++) {
+				sum[op].count[b] += th[t].hist[op].count[b];
+			}
+			sum[op].n += th[t].hist[op].n;
+			sum[op].errors += th[t].hist[op].errors;
+			if (th[t].hist[op].max > sum[op].max) {
+				sum[op].max = th[t].hist[op].max;
+			}
+		}
+	}
+	for (op = 0; op < OP_MAX; op++) {
+		printHist (op, &sum[op]);
+	}
+	/*last sample counts towards max too, else end could go past it*/
+	rss = rssKb ();
+	rssMax = (rss > rssMax) ? rss : rssMax;
+	printf ("{\"rss_start_kb\":%ld,\"rss_end_kb\":%ld,\"rss_max_kb\":%ld}\n", \
+			rssStart, rss, rssMax);
+
+	for (t = 0; t < nPkts; t++) {
+		free (pkts[t].xml);
+		free (pkts[t].attrTag);
+		free (pkts[t].attrName);
+	}
+	free (pkts);
+	free (sum);
+	free (th);
+
+	return 0;
+}
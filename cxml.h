@@ -6,10 +6,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stddef.h>
+#include <time.h>
 
 #include "cxml_cfg.h"
-
-#pragma pack(1)
+#include "cxml_api.h"
 
 /* Modifying cx_def_fmts and cx_def_sizes requires
  * modifying enum for data types - cxattr_type_t;
@@ -41,24 +42,167 @@
 
 #define NAME2STR(x) (#x)
 
+/* attrName/attrValue and tagField are not NULL terminated when they are
+ * views into the xml string of a zero-copy decoding session; always use
+ * nameLen/valueLen/tagLen along with them */
+/* nameId/symId is the ID of attrName/tagField in the global symbol table
+ * (see _cx_SymIntern), the name then points to the table's shared copy;
+ * 0 for names which are not interned, e.g. contents, comments */
 typedef struct cxn_attr_s {
     char                *attrName;
     char                *attrValue;
+    uint32_t            nameId;
+    uint32_t            nameLen;
+    uint32_t            valueLen;
     struct cxn_attr_s   *next;
 } cxn_attr_t;
 
+/**
+ * A node lives in node table of its session and refers to other nodes by
+ * their index in that table (see cx_nodetbl_t), 0 being no node.
+ * self - index of this node
+ * parent, children, lastChild, next - links of the tree
+ * end - index right after last node of this node's subtree; 0 while the
+ *       subtree may still grow at end of table. Valid only while table is
+ *       in document order, subtree of node i then is i..end-1
+ * nextSame - next element with same tag, see cx_tagidx_t
+ */
 typedef struct cx_node_s {
-    uint8_t             nodeType;
     char                *tagField;
-    struct cx_node_s    *parent;
+#if CX_USING_TAG_ATTR
+    cxn_attr_t          *attrList;
+    cxn_attr_t          *lastAttr;
+#endif
+    uint32_t            tagLen;
+    uint32_t            symId;
+    uint32_t            self;
+    uint32_t            parent;
+    uint32_t            children;
+    uint32_t            lastChild;
+    uint32_t            next;
+    uint32_t            end;
+    uint32_t            nextSame;
+    uint8_t             nodeType;
 #if CX_USING_TAG_ATTR
     uint8_t             numOfAttr;
-    cxn_attr_t          *attrList;/*Save tail-ptr to speedup additions -TODO*/
 #endif
-    struct cx_node_s    *children;
-    struct cx_node_s    *lastChild;
-    struct cx_node_s    *next;
-} __attribute__((__packed__)) cx_node_t;
+} cx_node_t;
+
+/*Node table blocks: block k holds CX_NODE_BLK_SZ << k nodes*/
+#define CX_NODE_BLK_SHIFT __builtin_ctz (CX_NODE_BLK_SZ)
+#define CX_NODE_MAX_BLKS  (32 - CX_NODE_BLK_SHIFT)
+
+/**
+ * Nodes of a session, in blocks of doubling size which never move, so that
+ * node pointers handed out stay valid as the table grows. Nodes are added
+ * at end of table; as long as every node also goes at end of document,
+ * which is always so for decoder, table is in document (pre)order and
+ * is walked front to back, subtrees being skipped by their end index.
+ * blk - blocks, block 0 is carved along with the cookie
+ * nBlks - number of blocks allocated, they are kept till session ends
+ * nNodes - number of indices used, index 0 (no node) included
+ * unordered - a node was inserted in between, table order is not document
+ *             order anymore; walks then follow links
+ */
+typedef struct cx_nodetbl_s {
+	cx_node_t           *blk[CX_NODE_MAX_BLKS];
+	uint32_t            nBlks;
+	uint32_t            nNodes;
+	int                 unordered;
+} cx_nodetbl_t;
+
+/*Index of block holding node idx, block k starts at B * (2^k - 1)*/
+#define CX_NODE_BLK(idx) \
+	(31 - __builtin_clz (((uint32_t)(idx) >> CX_NODE_BLK_SHIFT) + 1))
+
+/**
+ * A distinct tag name in tag index of a session
+ * next - next distinct tag name in the same hash bucket
+ * hash - hash of the tag name
+ * first, last - index of first/last element with the tag name in document order,
+ *               linked by their nextSame
+ */
+typedef struct cx_tagent_s {
+	struct cx_tagent_s  *next;
+	uint32_t            hash;
+	uint32_t            first;
+	uint32_t            last;
+} cx_tagent_t;
+
+/**
+ * Hash multimap from tag name to PARENT/SINGLE nodes of a session's tree.
+ * It is built on first lookup with a walk of the tree in document order, so
+ * sessions never searched (e.g. most decoded ones) don't pay for it, and
+ * is kept upto date by nodes added at end of document; a node inserted in
+ * between drops it, to be built again on next lookup.
+ * bucket - nBuckets (power of 2) chains of cx_tagent_t, NULL till built
+ * nEntries - number of distinct tag names
+ */
+typedef struct cx_tagidx_s {
+	cx_tagent_t         **bucket;
+	uint32_t            nBuckets;
+	uint32_t            nEntries;
+} cx_tagidx_t;
+
+#if CX_USING_LAZY
+/**
+ * An element in structural index of a lazy decoding session, entries being
+ * in document order and entry 0 being no element, as for nodes
+ * off - offset of '<' of its start tag in xs, tag name follows it
+ * close - offset right after '>' of its closing tag, or of its "/>"
+ * nameLen - length of tag name
+ * parent - entry of its parent element, 0 at top level; depth follows it
+ * end - entry right after last element of its subtree
+ * node - index of its node once its subtree is built, 0 till then
+ */
+typedef struct cx_lazyent_s {
+	uint64_t            off;
+	uint64_t            close;
+	uint32_t            nameLen;
+	uint32_t            parent;
+	uint32_t            end;
+	uint32_t            node;
+} cx_lazyent_t;
+
+/**
+ * Structural index of a CXDEC_LAZY session. Decoding only validates the xml
+ * string and records its elements here; a lookup builds the subtree of the
+ * element it finds, on its own, and a walk or change of the tree builds
+ * the rest around such subtrees (see _cx_LazyBuild)
+ * ent - maxEnts entries, kept across cx_ResetSession
+ * nEnts - entries used, entry 0 included; 0 if session isn't lazy
+ */
+typedef struct cx_lazyidx_s {
+	cx_lazyent_t        *ent;
+	uint32_t            nEnts;
+	uint32_t            maxEnts;
+} cx_lazyidx_t;
+#endif
+
+/**
+ * Bump allocator blocks backing all node/attr/string memory of a session
+ * next - block filled before this one
+ * size - usable bytes in data
+ * used - bytes already handed out from data
+ */
+typedef struct cx_arena_blk_s {
+	struct cx_arena_blk_s *next;
+	size_t              size;
+	size_t              used;
+	char                data[];
+} cx_arena_blk_t;
+
+/**
+ * head - block currently serving allocations
+ * embedded - first block, carved out along with the cookie, never freed
+ */
+typedef struct cx_arena_s {
+	cx_arena_blk_t      *head;
+	cx_arena_blk_t      *embedded;
+} cx_arena_t;
+
+#define CX_ARENA_ALIGN sizeof (void *)
+#define CX_ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
 
 /**
  * Structure used inside cxml library to identify particular user-cookie to
@@ -67,11 +211,27 @@ typedef struct cx_node_s {
  * name - name of the cookie  e.g. light-ctrl, high temp events, etc
  * root - root node of the tree built
  * recent - stores the most recently processed node
- * xmlLength - xmlLength & xstr store all tag/attr strings -TODO
- * uxsLength - user buffer xmlLength & xstr store all tag/attr strings
+ * xmlLength - exact length of the xml string the tree encodes to, '\0'
+ *             excluded; kept upto date as nodes/attrs are added, worked
+ *             out as it's encoded for a decoded tree
+ * decLength - for decoder, number of bytes consumed from xs; 0 for a tree
+ *             built with cx_BuildXxx
+ * uxsLength - size of buffer xs, '\0' included; for encoder's own buffer
+ *             it's the capacity kept across cx_EncPkt/cx_ResetSession
  * xsIsFromUserR - Indicates if xs is pointing to user-buffer
+ * xsIsDecoded - xs is the string a tree was decoded from, which the tree
+ *               may point into; it's never encoded into
+ * decFlags - cx_decflags_t the decoding session is set up with
  * xc - stores all node/attr contents -TODO
  * xs - stores actual xml string
+ * map, mapLen - file mapping xs points into, for sessions of cx_DecFile;
+ *               unmapped as the session is reset or destroyed
+ * arena - serves every node, attr and string of this session
+ * tagIdx - finds elements of the tree by tag name
+ * nodes - holds all nodes of the tree
+ * lazy - elements of a CXDEC_LAZY session, tree being built as looked up
+ * stats - counters of this session, see cx_GetStats
+ * flushed - part of stats already added to process-wide totals
  */
 typedef struct cx_cookie_s {
 #define CX_COOKIE_MAGIC   0x00C0FFEE
@@ -80,13 +240,80 @@ typedef struct cx_cookie_s {
 	char                name[CX_COOKIE_NAMELEN];
 	cx_node_t           *root;
 	cx_node_t           *recent;
-	uint32_t            xmlLength;
-	uint32_t            uxsLength;
+	uint64_t            xmlLength;
+	uint64_t            decLength;
+	uint64_t            uxsLength;
 	int                 xsIsFromUser;
+	int                 xsIsDecoded;
+	uint32_t            decFlags;
 	char                *xc;
 	char                *xs;
+	void                *map;
+	size_t              mapLen;
+	cx_arena_t          arena;
+	cx_tagidx_t         tagIdx;
+	cx_nodetbl_t        nodes;
+#if CX_USING_LAZY
+	cx_lazyidx_t        lazy;
+#endif
+#if CX_USING_STATS
+	cx_stats_t          stats;
+	cx_stats_t          flushed;
+#endif
 } cx_cookie_t;
 
+/*Node at index idx of session's node table, NULL for index 0*/
+static inline cx_node_t *_cx_Node (cx_cookie_t *cookie, uint32_t idx)
+{
+	uint32_t k = CX_NODE_BLK (idx);
+
+	return idx ? (cookie->nodes.blk[k] + idx - \
+			((CX_NODE_BLK_SZ << k) - CX_NODE_BLK_SZ)) : (cx_node_t *)NULL;
+}
+
+#define IS_ELEMENT(node) \
+	(((node)->nodeType == CXN_PARENT) || ((node)->nodeType == CXN_SINGLE))
+
+/*End of subtree of a node, see cx_node_t; while it's 0, it's end of table*/
+#define CX_NODE_END(cookie, node) \
+	((node)->end ? (node)->end : (cookie)->nodes.nNodes)
+
+/*Session owning an arena, every arena is part of a cookie*/
+#define CX_ARENA_COOKIE(arena) \
+	((cx_cookie_t *)((char *)(arena) - offsetof (cx_cookie_t, arena)))
+
+#if CX_USING_STATS
+static inline uint64_t _cx_StatNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+/* Counters are bumped on the session only, which is used by one thread at
+ * a time; _cx_StatsFlush hands the increase over to process-wide totals */
+#define CX_STAT_ADD(cookie, field, n) ((cookie)->stats.field += (n))
+#define CX_STAT_ALLOC(cookie, nBytes) \
+	((cookie)->stats.allocs++, (cookie)->stats.allocBytes += (nBytes))
+/*Start of a timed phase, and its end adding the time to phase's counter*/
+#define CX_STAT_NOW() _cx_StatNs ()
+#define CX_STAT_PHASE(cookie, phase, t0) \
+	((cookie)->stats.ns[phase] += _cx_StatNs () - (t0))
+
+void _cx_StatsFlush (cx_cookie_t *cookie);
+
+void _cx_StatsAdd (const cx_stats_t *delta);
+
+void _cx_StatsMerge (cx_stats_t *dst, const cx_stats_t *src);
+#else
+#define CX_STAT_ADD(cookie, field, n) ((void)0)
+#define CX_STAT_ALLOC(cookie, nBytes) ((void)0)
+#define CX_STAT_NOW() 0
+#define CX_STAT_PHASE(cookie, phase, t0) ((void)(t0))
+#define _cx_StatsFlush(cookie) ((void)0)
+#endif
+
 /**
  * @func   : _cx_calloc
  * @brief  : allocate memory and fill with 0's if success
@@ -122,8 +349,109 @@ typedef struct cx_cookie_s {
 #define _cx_free(ptr) \
 	do { if (ptr) { free (ptr); ptr = NULL; } } while (0)
 
-char *_cx_strndup (char *src, size_t maxLen, char *dName);
+/* Character classes the structural scanner looks for.
+ * '\0' is always a stop, so that unterminated scans end with the string */
+enum {
+	CX_SCAN_LT_IDX,     /* < */
+	CX_SCAN_GT_IDX,     /* > */
+	CX_SCAN_SLASH_IDX,  /* / */
+	CX_SCAN_EQ_IDX,     /* = */
+	CX_SCAN_QUOT_IDX,   /* " */
+	CX_SCAN_APOS_IDX,   /* ' */
+	CX_SCAN_SPACE_IDX,  /* space, \t, \r, \n */
+	CX_SCAN_NUL_IDX,    /* \0 */
+	CX_SCAN_NCLASS,
+};
+#define CX_SCAN_LT    (1U << CX_SCAN_LT_IDX)
+#define CX_SCAN_GT    (1U << CX_SCAN_GT_IDX)
+#define CX_SCAN_SLASH (1U << CX_SCAN_SLASH_IDX)
+#define CX_SCAN_EQ    (1U << CX_SCAN_EQ_IDX)
+#define CX_SCAN_QUOT  (1U << CX_SCAN_QUOT_IDX)
+#define CX_SCAN_APOS  (1U << CX_SCAN_APOS_IDX)
+#define CX_SCAN_SPACE (1U << CX_SCAN_SPACE_IDX)
+#define CX_SCAN_NUL   (1U << CX_SCAN_NUL_IDX)
+#define CX_SCAN_NAME_END \
+	(CX_SCAN_SPACE | CX_SCAN_SLASH | CX_SCAN_GT | CX_SCAN_EQ)
+
+extern const uint8_t _cx_CharClass[256];
+
+#if CX_USING_SIMD
+char *_cx_ScanRun (const char *ptr, const char *end, uint32_t classes);
+#endif
+
+/**
+ * @func   : _cx_acalloc
+ * @brief  : allocate zero filled memory from a session arena
+ * @called : when a node/attr is needed for the tree of a session
+ * @input  : arena - arena of the session owning the memory
+ *           nBytes - number of bytes for buffer allocation
+ * @output : ptr - pointer to hold allocated memory
+ * @return : 0 - Success
+ *           < 0 - for different failure conditions
+ */
+#define _cx_acalloc(arena, ptr, nBytes) \
+	({ ptr = _cx_ArenaAlloc (arena, nBytes); \
+	 ptr ? (memset (ptr, 0, nBytes), 0) : -ENOMEM;})
+
+void *_cx_ArenaAlloc (cx_arena_t *arena, size_t nBytes);
+
+void _cx_ArenaRelease (cx_arena_t *arena);
+
+void _cx_ArenaReset (cx_arena_t *arena);
+
+void _cx_Unmap (cx_cookie_t *cookie);
+
+char *_cx_strndup (cx_arena_t *arena, const char *src, size_t maxLen);
+
+cx_cookie_t *_cx_NewCookie (const char *name);
+
+cx_node_t *_cx_NewNode (cx_cookie_t *cookie);
+
+uint32_t _cx_NewNodes (cx_cookie_t *cookie, uint32_t n);
+
+#if CX_USING_POOL
+/*Work on item i of a _cx_PoolRun*/
+typedef void (*cx_job_t) (void *arg, uint32_t i);
+
+uint32_t _cx_PoolThreads (uint32_t nThreads);
+
+void _cx_PoolRun (cx_job_t job, void *arg, uint32_t n, uint32_t nThreads);
+#endif
+
+#if CX_USING_SYMTAB
+uint32_t _cx_SymIntern (const char *name, uint32_t len, const char **symName);
+
+uint32_t _cx_SymFind (const char *name, uint32_t len);
+#else
+#define _cx_SymIntern(name, len, symName) ((void)(symName), 0)
+#define _cx_SymFind(name, len) 0
+#endif
+
+/*Names with IDs on both sides are equal only if IDs are, else compare them*/
+#define CX_NAME_EQ(aId, aName, aLen, bId, bName, bLen) \
+	(((aId) && (bId)) ? ((aId) == (bId)) : \
+	 (((aLen) == (bLen)) && !memcmp (aName, bName, aLen)))
+
+void _cx_TagIndexAdd (cx_cookie_t *cookie, cx_node_t *node);
+
+#if CX_USING_LAZY
+/*Tree of a lazy session is not built yet, subtrees looked up may be*/
+#define CX_LAZY_PENDING(cookie) \
+	(((cookie)->lazy.nEnts > 1) && !(cookie)->root)
+
+cx_status_t _cx_LazyBuild (cx_cookie_t *cookie);
+
+cx_node_t *_cx_LazyFind (cx_cookie_t *cookie, const char *name, uint32_t len, \
+		uint32_t *e);
+#else
+#define CX_LAZY_PENDING(cookie) 0
+#define _cx_LazyBuild(cookie) CX_SUCCESS
+#endif
+
+#if CX_USING_READER
+int _cx_ReaderInTag (const cx_reader_t *rd);
+#endif
 
-cx_node_t *cx_FindNodeWithTag (void *_cookie, char *name);
+CX_API cx_node_t *cx_FindNodeWithTag (void *_cookie, char *name);
 
 #endif /*__CXML_H*/
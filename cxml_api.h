@@ -7,7 +7,20 @@
 
 #include "cxml_cfg.h"
 
-#pragma pack(1)
+/* Functions of the library's API, directly or through macros here; shared
+ * library is built with -fvisibility=hidden, so all else stays internal */
+#define CX_API __attribute__((visibility ("default")))
+
+/* Thread safety:
+ * A session (cookie) is not locked, it must be used by one thread at a time;
+ * different sessions can be used by different threads all at once. All
+ * that sessions share is read-only tables, the symbol table (lock-free
+ * lookups, locked insertions), one-time SIMD kernel choice (atomic), the
+ * worker pool of cx_DecBatch/cx_DecBuf/cx_EncBuf (locked), process-wide
+ * counters (per thread, summed under a lock) and trace rings (per thread,
+ * dumped without stopping them); so every API here is thread-safe on
+ * sessions of its own, cx_strerr on any status, cx_GetStats on NULL and
+ * cx_TraceXxx from anywhere */
 
 typedef enum {
     CX_SUCCESS = 0,
@@ -46,6 +59,15 @@ typedef enum {
 
 	/*Unidentified errors*/
     CX_FAILURE,
+
+	/*Errors added later go after CX_FAILURE, values callers (and builds of
+	 *the shared library) know of never change*/
+
+	/*File errors*/
+	CX_ERR_FILE,
+
+	/*Query errors*/
+	CX_ERR_INVALID_QUERY,
 } cx_status_t;
 
 typedef enum {
@@ -83,6 +105,28 @@ typedef enum {
     CXADD_MAXTYPE,
 } cx_Addtype_t;
 
+typedef enum {
+    CXDEC_COPY      = 0x00, /*tree holds its own copy of all strings*/
+    CXDEC_ZEROCOPY  = 0x01, /*tree strings are views into the xml string*/
+    CXDEC_REUSE     = 0x02, /*decode into the session given, after a reset*/
+    CXDEC_LAZY      = 0x04, /*build nodes only as they are looked up*/
+} cx_decflags_t;
+
+/*What a filter does with elements of its tag names/paths*/
+typedef enum {
+    CXFLT_KEEP,     /*build just them, their subtrees and their ancestors*/
+    CXFLT_DROP,     /*build all but them and their subtrees*/
+} cx_filtmode_t;
+
+/*Tag names/paths to filter a decoding with, see cx_FilterCreate*/
+typedef struct cx_filter_s cx_filter_t;
+
+/*Path query compiled by cx_QueryCompile*/
+typedef struct cx_query_s cx_query_t;
+
+/*A node of a session's tree, opaque to users; builder API hands them out*/
+typedef struct cx_node_s cx_node_t;
+
 typedef union attrValue_union {
     char      *str;
     char      ch;
@@ -105,8 +149,41 @@ typedef union attrValue_union {
  * @output : char **xmlData - pointer to store the final xml string 
  * @return : CX_SUCCESS on success
  *           non-zero value indicating type of failure
+ * a decoded tree is encoded into a buffer of the library, never into the
+ * string it was decoded from
+ */
+CX_API cx_status_t cx_EncPkt (void *_cookie, char **xmlData);
+
+/**
+ * @func   : cx_EncBuf
+ * @brief  : cx_EncPkt with no limit on xml string size; children of root
+ *           of trees encoding to atleast CX_PAR_ENC_MIN_SZ bytes are
+ *           encoded on several threads, each straight into its place
+ * @called : for big documents, e.g. exports
+ * @input  : void *_cookie - pointer to select xml-context
+ *           uint32_t nThreads - most threads to use, calling thread
+ *                               included; 1 to encode in a single pass,
+ *                               0 for one per online cpu
+ * @output : char **xmlData - pointer to store the final xml string
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ * xml string is byte by byte the same as that of a single pass
+ */
+CX_API cx_status_t cx_EncBuf (void *_cookie, char **xmlData, uint32_t nThreads);
+
+/**
+ * @func   : cx_EncLength
+ * @brief  : gives exact length of the xml string cx_EncPkt would build
+ *           from the tree as it is now
+ * @called : before cx_EncPkt, to size a buffer once for the xml string
+ * @input  : void *_cookie - pointer to a valid xml-context
+ * @output : none
+ * @return : length of xml string excluding '\0', i.e. a user buffer needs
+ *           1 more byte; 0 for an invalid cookie or an empty tree
+ * length of a decoded tree is worked out on each call, a lazy one being
+ * built first
  */
-cx_status_t cx_EncPkt (void *_cookie, char **xmlData);
+CX_API uint64_t cx_EncLength (void *_cookie);
 
 /**
  * @func   : cx_DecPkt
@@ -119,7 +196,495 @@ cx_status_t cx_EncPkt (void *_cookie, char **xmlData);
  * @return : CX_SUCCESS on success
  *           non-zero value indicating type of failure
  */
-cx_status_t cx_DecPkt (void **_cookie, char *str, char *name);
+#define cx_DecPkt(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_COPY)
+
+/**
+ * @func   : cx_DecPktZeroCopy
+ * @brief  : same as cx_DecPkt, but tag names, contents and attributes of
+ *           the tree are not copied, they refer to the xml string in place
+ * @called : when the xml string is kept intact till the session is destroyed
+ *           and a decoded packet should cost as less memory as possible
+ * @input  : char *str - existing xml string, must outlive the session
+ *           char *name - name of this decoding session cookie
+ * @output : void **_cookie - pointer filled to the freshly created xml-context
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_DecPktZeroCopy(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_ZEROCOPY)
+
+/**
+ * @func   : cx_DecPktReuse
+ * @brief  : same as cx_DecPkt, but decodes into the session *_cookie has
+ *           from an earlier decoding, after a cx_ResetSession; the session
+ *           and its memory are reused, so per packet cost is parsing only
+ * @called : for every packet of a stream of packets, e.g. on a long-lived
+ *           connection; cx_DestroySession once the stream ends
+ * @input  : void **_cookie - a decoder session to reuse, or NULL for the
+ *                            first packet to create one
+ *           char *str - existing xml string
+ *           char *name - name of the session, if it's created
+ * @output : void **_cookie - filled to the session the tree is in; it
+ *                            stays valid even if decoding fails
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_DecPktReuse(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_COPY | CXDEC_REUSE)
+
+/**
+ * @func   : cx_DecPktZeroCopyReuse
+ * @brief  : cx_DecPktReuse with tree strings as views into str, as done by
+ *           cx_DecPktZeroCopy
+ * @called : same as cx_DecPktReuse, str must outlive the decoded tree
+ * @input  : void **_cookie - a decoder session to reuse, or NULL
+ *           char *str - existing xml string
+ *           char *name - name of the session, if it's created
+ * @output : void **_cookie - filled to the session the tree is in
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_DecPktZeroCopyReuse(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_ZEROCOPY | CXDEC_REUSE)
+
+#if CX_USING_LAZY
+/**
+ * @func   : cx_DecPktLazy
+ * @brief  : validate an xml string and index its elements, without building
+ *           any node; cx_FindNodeWithTag/cx_FindFirst/cx_GetAttrValue build
+ *           just the subtree of the element they find, the rest of the tree
+ *           is built only if it is encoded or changed; str is never
+ *           written to, an encoded string goes in a buffer of the library
+ * @called : for packets of big trees of which only a few nodes are read
+ * @input  : void **_cookie - pointer to hold new decoder xml-context
+ *           char *str - existing xml string, which must outlive the
+ *                       session, as for cx_DecPktZeroCopy
+ *           char *name - name of the session
+ * @output : void **_cookie - decoder session
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure, same as cx_DecPkt
+ */
+#define cx_DecPktLazy(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_ZEROCOPY | CXDEC_LAZY)
+
+/**
+ * @func   : cx_DecPktLazyReuse
+ * @brief  : cx_DecPktLazy into the session *_cookie has, as done by
+ *           cx_DecPktReuse
+ * @called : for every packet of a stream of such packets
+ * @input  : void **_cookie - a decoder session to reuse, or NULL
+ *           char *str - existing xml string, must outlive the decoded tree
+ *           char *name - name of the session, if it's created
+ * @output : void **_cookie - filled to the session the tree is in
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_DecPktLazyReuse(_cookie, str, name) \
+    _cx_DecPkt (_cookie, str, name, CXDEC_ZEROCOPY | CXDEC_LAZY | CXDEC_REUSE)
+#endif
+
+CX_API cx_status_t _cx_DecPkt (void **_cookie, char *str, char *name, uint32_t decFlags);
+
+#if CX_USING_FILTER
+/**
+ * @func   : cx_FilterCreate
+ * @brief  : set up a filter of tag names/paths for cx_DecPktFilter; a tag
+ *           name, e.g. "status", is of elements at any depth, a path, e.g.
+ *           "inventory/status" or "/inventory", is of elements with just
+ *           those ancestors from a top level element down
+ * @called : once, for many decodings; a filter is only read by them, so it
+ *           can be used by many threads at once
+ * @input  : cx_filtmode_t mode - CXFLT_KEEP or CXFLT_DROP elements of tags
+ *           const char *tags[] - n tag names/paths
+ *           uint32_t n - 1 to CX_FILTER_MAX_TAGS
+ * @output : cx_filter_t **filter - new filter
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_INVALID_TAG if n or a tag name/path isn't right
+ *           non-zero value indicating type of failure, otherwise
+ */
+CX_API cx_status_t cx_FilterCreate (cx_filter_t **filter, cx_filtmode_t mode, const char *tags[], uint32_t n);
+
+/**
+ * @func   : cx_FilterDestroy
+ * @brief  : free a filter
+ * @called : once no decoding uses the filter anymore
+ * @input  : cx_filter_t *filter - filter from cx_FilterCreate, or NULL
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_FilterDestroy (cx_filter_t *filter);
+
+/**
+ * @func   : cx_DecPktFilter
+ * @brief  : cx_DecPkt building only what a filter lets through; dropped
+ *           subtrees are just scanned, counting depth and checking their
+ *           closing tags, with no node/attr/string made for them.
+ *           CXFLT_KEEP also drops contents/comments of ancestors of kept
+ *           elements, only their attrs are kept
+ * @called : when only a branch of a big xml string is needed
+ * @input  : void **_cookie - pointer to hold new decoder xml-context
+ *           char *str - existing xml string
+ *           char *name - name of the session
+ *           const cx_filter_t *filter - filter from cx_FilterCreate
+ * @output : void **_cookie - decoder session with the filtered tree
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_NODE_NOT_FOUND if a valid xml string has nothing left
+ *           non-zero value indicating type of failure, same as cx_DecPkt;
+ *           CX_ERR_DEC_OVERFLOW also for more than CX_FILTER_MAX_DEPTH
+ *           nested elements
+ */
+#define cx_DecPktFilter(_cookie, str, name, filter) \
+    _cx_DecPktFilter (_cookie, str, name, CXDEC_COPY, filter)
+
+/*decFlags - as for _cx_DecPkt, but CXDEC_LAZY isn't taken along a filter*/
+CX_API cx_status_t _cx_DecPktFilter (void **_cookie, char *str, char *name, uint32_t decFlags, const cx_filter_t *filter);
+#endif
+
+/**
+ * @func   : cx_DecBuf
+ * @brief  : decode an xml document of known length, with no limit on its
+ *           size; body of its first big element is split into chunks at
+ *           child tags and decoded on several threads, if it is atleast
+ *           CX_PAR_DEC_MIN_SZ bytes
+ * @called : for big documents, e.g. exports, files read/mapped in memory
+ * @input  : void **_cookie - pointer to hold new decoder xml-context
+ *           char *buf - xml document, need not be NULL terminated
+ *           uint64_t len - number of bytes in buf
+ *           char *name - name of the session
+ *           uint32_t nThreads - most threads to use, calling thread
+ *                               included; 1 to decode in a single pass,
+ *                               0 for one per online cpu
+ * @output : void **_cookie - decoder session with the tree
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ * Tree and failures are just the same as that of a single pass decoding
+ */
+#define cx_DecBuf(_cookie, buf, len, name, nThreads) \
+    _cx_DecBuf (_cookie, buf, len, name, CXDEC_COPY, nThreads)
+
+/**
+ * @func   : cx_DecBufZeroCopy
+ * @brief  : cx_DecBuf with tree strings being views into buf
+ *           (see cx_DecPktZeroCopy)
+ * @called : for big documents which stay in memory along with their tree
+ * @input  : same as cx_DecBuf
+ * @output : void **_cookie - decoder session with the tree
+ * @return : same as cx_DecBuf
+ */
+#define cx_DecBufZeroCopy(_cookie, buf, len, name, nThreads) \
+    _cx_DecBuf (_cookie, buf, len, name, CXDEC_ZEROCOPY, nThreads)
+
+CX_API cx_status_t _cx_DecBuf (void **_cookie, char *buf, uint64_t len, char *name, uint32_t decFlags, uint32_t nThreads);
+
+/**
+ * @func   : cx_DecFile
+ * @brief  : decode an xml file in place: it's mapped read-only, with a hint
+ *           of sequential access, and decoded as by cx_DecBufZeroCopy, so
+ *           tree strings are views into the mapping and files of any size
+ *           are decoded without being read/copied into memory
+ * @called : for big xml files, e.g. exports on disk
+ * @input  : void **_cookie - pointer to hold new decoder xml-context
+ *           const char *path - xml file, also the name of the session
+ *           uint32_t nThreads - same as for cx_DecBuf
+ * @output : void **_cookie - decoder session with the tree; file stays
+ *                            mapped until cx_ResetSession/cx_DestroySession
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_FILE if the file can't be opened/mapped or is empty
+ *           CX_ERR_DEC_OVERFLOW if a single name, text, cdata, comment or
+ *           attr value is 4 GiB or longer, nodes keep 32-bit lengths
+ *           non-zero value indicating type of failure, otherwise
+ * File must not be truncated while the session has it mapped
+ */
+#define cx_DecFile(_cookie, path, nThreads) \
+    _cx_DecFile (_cookie, path, CXDEC_ZEROCOPY, nThreads)
+
+CX_API cx_status_t _cx_DecFile (void **_cookie, const char *path, uint32_t decFlags, uint32_t nThreads);
+
+#if CX_USING_POOL
+/**
+ * @func   : cx_DecBatch
+ * @brief  : decode many independent xml strings in parallel, on a pool of
+ *           worker threads which steal packets from each other as they
+ *           finish their share
+ * @called : when a burst of packets is to be decoded at once
+ * @input  : char *inputs[] - n xml strings
+ *           uint32_t n - number of xml strings
+ *           void *cookies[] - n decoder sessions to reuse as by
+ *                             cx_DecPktReuse, NULL entries get a new one
+ *           uint32_t nThreads - most threads to use, calling thread
+ *                               included; 0 for one per online cpu
+ * @output : void *cookies[] - session of each xml string, valid even if its
+ *                             decoding failed; keep them for next batch
+ *                             and destroy them with cx_DestroySession
+ * @return : CX_SUCCESS if all are decoded
+ *           status of the first xml string which failed, otherwise
+ * Only one batch runs on the pool at a time, concurrent calls wait
+ */
+#define cx_DecBatch(inputs, n, cookies, nThreads) \
+    _cx_DecBatch (inputs, n, cookies, NULL, nThreads, CXDEC_COPY)
+
+/**
+ * @func   : cx_DecBatchStatus
+ * @brief  : cx_DecBatch also giving status of every xml string
+ * @called : when failed packets of a batch are to be found
+ * @input  : same as cx_DecBatch
+ * @output : void *cookies[] - as cx_DecBatch
+ *           cx_status_t status[] - n statuses, one per xml string
+ * @return : same as cx_DecBatch
+ */
+#define cx_DecBatchStatus(inputs, n, cookies, status, nThreads) \
+    _cx_DecBatch (inputs, n, cookies, status, nThreads, CXDEC_COPY)
+
+CX_API cx_status_t _cx_DecBatch (char *inputs[], uint32_t n, void *cookies[], cx_status_t status[], uint32_t nThreads, uint32_t decFlags);
+
+/**
+ * @func   : cx_PoolDestroy
+ * @brief  : stop the worker threads of cx_DecBatch, cx_DecBuf and cx_EncBuf
+ * @called : at exit, or when no more batches are coming for long; next
+ *           call of those starts them again
+ * @input  : none
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_PoolDestroy (void);
+#endif /*CX_USING_POOL*/
+
+/**
+ * @func   : cx_DecLength
+ * @brief  : gives number of bytes the decoder consumed from the xml string
+ * @called : after a successful cx_DecPkt, e.g. to find where next data begins
+ * @input  : void *_cookie - pointer to a valid decoder xml-context
+ * @output : none
+ * @return : number of bytes consumed, 0 for an invalid cookie
+ */
+CX_API uint64_t cx_DecLength (void *_cookie);
+
+/**
+ * Callbacks of a streaming decoder session, any of them may be NULL
+ * user - opaque pointer given to cx_CreateSaxSession, passed back as is
+ * Strings are not NULL terminated and are valid only during the callback.
+ * Text, cdata and comment strings may come in several fragments as chunks
+ * arrive, isLast is set on the final (possibly empty) fragment of each.
+ * A callback returning other than CX_SUCCESS stops the decoding, cx_DecFeed
+ * then returns the same status
+ */
+typedef cx_status_t (*cx_saxdata_cb_t) (void *user, const char *data, uint32_t len, int isLast);
+
+typedef struct cx_saxcb_s {
+	cx_status_t (*startTag) (void *user, const char *tag, uint32_t tagLen);
+	cx_status_t (*attr) (void *user, const char *name, uint32_t nameLen, \
+			const char *value, uint32_t valueLen);
+	cx_status_t (*endTag) (void *user, const char *tag, uint32_t tagLen);
+	cx_saxdata_cb_t     content;
+	cx_saxdata_cb_t     cdata;
+	cx_saxdata_cb_t     comment;
+} cx_saxcb_t;
+
+/**
+ * @func   : cx_CreateSaxSession
+ * @brief  : setup a streaming decoder session which emits callbacks for
+ *           an xml string fed piece by piece, without building a tree
+ * @called : when xml documents arrive in pieces, e.g. TCP segments, or are
+ *           bigger than CX_MAX_DEC_STR_SZ
+ * @input  : char *name - name of this decoding session
+ *           const cx_saxcb_t *cb - callbacks to emit, copied into session
+ *           void *user - opaque pointer passed to every callback
+ * @output : void **_ctx - pointer filled to the freshly created session
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+CX_API cx_status_t cx_CreateSaxSession (void **_ctx, char *name, const cx_saxcb_t *cb, void *user);
+
+/**
+ * @func   : cx_DecFeed
+ * @brief  : decode next chunk of the xml string, emitting callbacks for all
+ *           complete or partial items in it; a tag/attr/text split over
+ *           chunks is continued with the next cx_DecFeed; bytes before
+ *           first '<' of the xml string are skipped, as by cx_DecPkt
+ * @called : for every piece of the xml string as it arrives, in order
+ * @input  : void *_ctx - streaming decoder session
+ *           const char *chunk - next bytes of the xml string
+ *           uint32_t len - number of bytes in chunk
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure, which sticks to the
+ *           session; all later calls return the same
+ */
+CX_API cx_status_t cx_DecFeed (void *_ctx, const char *chunk, uint32_t len);
+
+/**
+ * @func   : cx_DecFeedEnd
+ * @brief  : tells the streaming decoder the xml string is complete
+ * @called : after the last cx_DecFeed of a document
+ * @input  : void *_ctx - streaming decoder session
+ * @output : none
+ * @return : CX_SUCCESS if a complete document was fed
+ *           non-zero value indicating type of failure
+ */
+CX_API cx_status_t cx_DecFeedEnd (void *_ctx);
+
+/**
+ * @func   : cx_DestroySaxSession
+ * @brief  : Destroy an existing streaming decoder session
+ * @called : when particular streaming decoder is no more required
+ * @input  : void *_ctx - pointer to a valid streaming decoder session
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_DestroySaxSession (void *_ctx);
+
+#if CX_USING_READER
+/*Events pulled out of an xml string by cx_ReaderNext*/
+typedef enum {
+    CXEV_START,     /*start tag, name is set; a "<a/>" gives START, END*/
+    CXEV_ATTR,      /*attr of the last START, name and value are set*/
+    CXEV_TEXT,      /*content of an element, value is set*/
+    CXEV_CDATA,     /*cdata, value is set*/
+    CXEV_COMMENT,   /*comment, value is set*/
+    CXEV_END,       /*closing tag, name is set*/
+    CXEV_EOF,       /*end of a valid xml string, given again by later calls*/
+} cx_evtype_t;
+
+/**
+ * An event of cx_ReaderNext, strings are not NULL terminated and are views
+ * into the xml string, valid as long as it is. Instructions are skipped.
+ * Spaces before a text/comment are left out, just as in decoded trees
+ */
+typedef struct cx_event_s {
+	cx_evtype_t         type;
+	const char          *name;
+	uint32_t            nameLen;
+	const char          *value;
+	uint64_t            valueLen;
+} cx_event_t;
+
+/**
+ * A cursor over an xml string, owned by caller, e.g. on its stack; all its
+ * fields are private to cx_ReaderOpen/cx_ReaderNext
+ */
+typedef struct cx_reader_s {
+	const char          *cur;
+	const char          *end;
+	uint32_t            state;
+	uint32_t            depth;
+	cx_status_t         xStatus;
+	int                 seen;
+	struct {
+		const char      *tag;
+		uint32_t        len;
+	} open[CX_READER_MAX_DEPTH];
+} cx_reader_t;
+
+/**
+ * @func   : cx_ReaderOpen
+ * @brief  : set up a reader to pull events out of an xml string one by one,
+ *           with the same tag detection and checks as cx_DecBuf, but no
+ *           tree, session or allocation at all
+ * @called : when values of an xml string are just to be forwarded or
+ *           aggregated, so it needs no tree, e.g. for documents of any size
+ * @input  : const char *buf - xml string, it is not written to
+ *           uint64_t len - number of bytes in buf, a '\0' ends it earlier
+ * @output : cx_reader_t *rd - reader positioned at first '<' of buf
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+CX_API cx_status_t cx_ReaderOpen (cx_reader_t *rd, const char *buf, uint64_t len);
+
+/**
+ * @func   : cx_ReaderNext
+ * @brief  : pull next event of the xml string
+ * @called : in a loop after cx_ReaderOpen, until CXEV_EOF or a failure
+ * @input  : cx_reader_t *rd - reader from cx_ReaderOpen
+ * @output : cx_event_t *ev - the event
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure, same as cx_DecBuf
+ *           would give for the xml string, which sticks to the reader;
+ *           all later calls return the same. CX_ERR_DEC_OVERFLOW also for
+ *           more than CX_READER_MAX_DEPTH nested elements
+ */
+CX_API cx_status_t cx_ReaderNext (cx_reader_t *rd, cx_event_t *ev);
+#endif /*CX_USING_READER*/
+
+#if CX_USING_QUERY
+/**
+ * @func   : cx_QueryCompile
+ * @brief  : compile a path query, to be run on many sessions/readers
+ *           Path is of steps from top level elements down:
+ *             a/b     - b children of a top level a; a leading '/' is same
+ *             a//b    - b anywhere under a, "//b" is b anywhere at all
+ *             *       - element of any tag
+ *             b[3]    - 3rd of b children of same parent, from 1
+ *             b[@k]   - b having attr k
+ *             b[@k='v'] or b[@k="v"] - b having attr k of value v
+ *             a/b/@k  - attr k of a/b elements, only as last step
+ *           A step takes many tests, in order: b[@k='v'][2] is 2nd of b
+ *           with k="v", b[2][@k='v'] is 2nd of b if it has k="v"; atmost
+ *           one position of each step
+ * @called : once, for many runs; a query is only read by them, so it can be
+ *           used by many threads at once
+ * @input  : const char *path - the path
+ * @output : cx_query_t **query - new query
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_INVALID_QUERY if path isn't right, or is over limits of
+ *           CX_QUERY_MAX_STEPS/CX_QUERY_MAX_ATTRS
+ *           non-zero value indicating type of failure, otherwise
+ */
+CX_API cx_status_t cx_QueryCompile (cx_query_t **query, const char *path);
+
+/**
+ * @func   : cx_QueryDestroy
+ * @brief  : free a query
+ * @called : once no run uses the query anymore
+ * @input  : cx_query_t *query - query from cx_QueryCompile, or NULL
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_QueryDestroy (cx_query_t *query);
+
+/**
+ * @func   : cx_QueryRun
+ * @brief  : find first match of a query in tree of a session, in document
+ *           order; only subtrees the query can match in are walked, and
+ *           walk stops at first match
+ * @called : after a successful decoding/building of the tree
+ * @input  : void *_cookie - pointer to a valid xml-context
+ *           const cx_query_t *query - query from cx_QueryCompile
+ * @output : cx_node_t **node - element matched, or owning the attr matched
+ *           const char **value, uint32_t *valueLen - value of attr matched,
+ *                      NULL and 0 if query isn't of an attr; both of them
+ *                      may be NULL if not needed. Value is not NULL
+ *                      terminated in zero-copy sessions
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_NODE_NOT_FOUND if nothing matches
+ *           CX_ERR_DEC_OVERFLOW if the query needs to go more than
+ *           CX_QUERY_MAX_DEPTH elements deep
+ *           non-zero value indicating type of failure, otherwise
+ */
+CX_API cx_status_t cx_QueryRun (void *_cookie, const cx_query_t *query, cx_node_t **node, const char **value, uint32_t *valueLen);
+
+#if CX_USING_READER
+/**
+ * @func   : cx_QueryRead
+ * @brief  : pull events of a reader upto first match of a query, so that
+ *           an xml string is decoded just as far as the match
+ * @called : on a reader just opened, instead of pulling its events; or
+ *           on one at top level, i.e. with no element open
+ * @input  : cx_reader_t *rd - reader from cx_ReaderOpen
+ *           const cx_query_t *query - query from cx_QueryCompile
+ * @output : cx_event_t *ev - CXEV_START of element matched, or CXEV_ATTR of
+ *                            attr matched
+ *           cx_reader_t *rd - left after attrs of element matched, so next
+ *                             cx_ReaderNext gives what's in it
+ * @return : CX_SUCCESS on success
+ *           CX_ERR_NODE_NOT_FOUND if nothing matches in a valid xml string
+ *           CX_ERR_INVALID_QUERY if an element is open in reader
+ *           non-zero value indicating type of failure, same as for
+ *           cx_ReaderNext
+ */
+CX_API cx_status_t cx_QueryRead (cx_reader_t *rd, const cx_query_t *query, cx_event_t *ev);
+#endif
+#endif /*CX_USING_QUERY*/
 
 /**
  * @func   : cx_AddFirstNode
@@ -233,7 +798,7 @@ cx_status_t cx_DecPkt (void **_cookie, char *str, char *name);
 #define cx_AddContentNode(_cookie, content, addTo, addType) \
     _cx_AddNode (_cookie, content, CXN_CONTENT, addTo, addType)
 
-cx_status_t _cx_AddNode (void *_cookie, const char *new, cxn_type_t nodeType, const char *addTo, cx_Addtype_t addType);
+CX_API cx_status_t _cx_AddNode (void *_cookie, const char *new, cxn_type_t nodeType, const char *addTo, cx_Addtype_t addType);
 
 /**
  * @func   : cx_AddAttr_CHAR
@@ -380,7 +945,278 @@ cx_status_t _cx_AddNode (void *_cookie, const char *new, cxn_type_t nodeType, co
 			(cxa_value_u *)&attrValue, CXATTR_FLOAT, node)
 
 #if CX_USING_TAG_ATTR
-cx_status_t _cx_AddAttrToNode (void *_cookie, char *attrName, cxa_value_u *value, cxattr_type_t type, char *node);
+CX_API cx_status_t _cx_AddAttrToNode (void *_cookie, char *attrName, cxa_value_u *value, cxattr_type_t type, char *node);
+#endif /*CX_USING_TAG_ATTR*/
+
+/* Builder API: every node added gives out its handle, which later adds and
+ * attrs take directly; so a tree is built without any name lookups and a
+ * node can be added anywhere, next to or as last child of any node.
+ * Handles are valid till the session is destroyed */
+
+/**
+ * @func   : cx_BuildRoot
+ * @brief  : adds first(root) node to tree and gives its handle
+ * @called : when building a tree with handles, before any other node
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *name - tagField
+ *           cxn_type_t nodeType - type of node
+ * @output : cx_node_t **node - handle of the root node
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildRoot(_cookie, name, nodeType, node) \
+    _cx_BuildNode (_cookie, name, nodeType, NULL, CXADD_FIRST, node)
+
+/**
+ * @func   : cx_BuildParent
+ * @brief  : adds PARENT type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *name - tagField
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildParent(_cookie, name, at, addType, node) \
+    _cx_BuildNode (_cookie, name, CXN_PARENT, at, addType, node)
+
+/**
+ * @func   : cx_BuildSingle
+ * @brief  : adds SINGLE type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *name - tagField
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildSingle(_cookie, name, at, addType, node) \
+    _cx_BuildNode (_cookie, name, CXN_SINGLE, at, addType, node)
+
+#if CX_USING_COMMENTS
+/**
+ * @func   : cx_BuildComment
+ * @brief  : adds COMMENT type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *comment - comment string
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildComment(_cookie, comment, at, addType, node) \
+    _cx_BuildNode (_cookie, comment, CXN_COMMENT, at, addType, node)
+#endif
+
+#if CX_USING_CDATA
+/**
+ * @func   : cx_BuildCData
+ * @brief  : adds CDATA type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *CData - CDATA string
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildCData(_cookie, CData, at, addType, node) \
+    _cx_BuildNode (_cookie, CData, CXN_CDATA, at, addType, node)
+#endif
+
+#if CX_USING_INSTR
+/**
+ * @func   : cx_BuildInstr
+ * @brief  : adds INSTRUCTION type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *instr - instruction string
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildInstr(_cookie, instr, at, addType, node) \
+    _cx_BuildNode (_cookie, instr, CXN_INSTR, at, addType, node)
+#endif
+
+/**
+ * @func   : cx_BuildContent
+ * @brief  : adds CONTENT type node to tree at a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           char *content - content string
+ *           cx_node_t *at - handle of node to which current node is added
+ *           cx_Addtype_t addType - CXADD_CHILD to add as last child of at,
+ *                                  CXADD_NEXT to add right next to at
+ * @output : cx_node_t **node - handle of new node, may be NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildContent(_cookie, content, at, addType, node) \
+    _cx_BuildNode (_cookie, content, CXN_CONTENT, at, addType, node)
+
+CX_API cx_status_t _cx_BuildNode (void *_cookie, const char *new, cxn_type_t nodeType, cx_node_t *at, cx_Addtype_t addType, cx_node_t **node);
+
+#if CX_USING_TAG_ATTR
+/**
+ * @func   : cx_BuildAttr_CHAR
+ * @brief  : adds CHAR type attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_CHAR(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_CHAR)
+
+/**
+ * @func   : cx_BuildAttr_STR
+ * @brief  : adds STRING type attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_STR(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)attrValue, CXATTR_STR)
+
+/**
+ * @func   : cx_BuildAttr_ui8
+ * @brief  : adds unsigned 8-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_ui8(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_UI8)
+
+/**
+ * @func   : cx_BuildAttr_si8
+ * @brief  : adds signed 8-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_si8(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_SI8)
+
+/**
+ * @func   : cx_BuildAttr_ui16
+ * @brief  : adds unsigned 16-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_ui16(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_UI16)
+
+/**
+ * @func   : cx_BuildAttr_si16
+ * @brief  : adds signed 16-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_si16(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_SI16)
+
+/**
+ * @func   : cx_BuildAttr_ui32
+ * @brief  : adds unsigned 32-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_ui32(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_UI32)
+
+/**
+ * @func   : cx_BuildAttr_si32
+ * @brief  : adds signed 32-bit int attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_si32(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_SI32)
+
+/**
+ * @func   : cx_BuildAttr_float
+ * @brief  : adds float type attribute to attr list of a node handle
+ * @called : when building a tree with handles
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - handle of PARENT/SINGLE node
+ *           char *attrName - name of attr (converted to name string)
+ *           cxa_value_u attrValue - union specifying for pre-defined datatype
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+#define cx_BuildAttr_float(_cookie, node, attrname, attrValue) \
+    _cx_BuildAttr (_cookie, node, attrname, \
+			(cxa_value_u *)&attrValue, CXATTR_FLOAT)
+
+CX_API cx_status_t _cx_BuildAttr (void *_cookie, cx_node_t *node, char *attrName, cxa_value_u *value, cxattr_type_t type);
 #endif /*CX_USING_TAG_ATTR*/
 
 /**
@@ -389,12 +1225,26 @@ cx_status_t _cx_AddAttrToNode (void *_cookie, char *attrName, cxa_value_u *value
  * @called : when new xml encoding session is required, NOT FOR DECODER SESSION
  * @input  : char *name - name identifying the purpose of this session
  *           char *uxs - optional string pointer for encoder to from xml string
- *           initXmlLength - Iff uxs is valid, gives an initial length
+ *           initXmlLength - Iff uxs is valid, gives size of uxs in bytes;
+ *                           0 if uxs is known to fit CX_MAX_ENC_STR_SZ
+ *                           characters and a '\0'
  * @output : void *_cookie - pointer to xml-context after proper session setup
  * @return : CX_SUCCESS on success
  *           non-zero value indicating type of failure
  */
-cx_status_t cx_CreateSession (void **_cookie, char *name, char *uxs, uint32_t initXmlLength);
+CX_API cx_status_t cx_CreateSession (void **_cookie, char *name, char *uxs, uint32_t initXmlLength);
+
+/**
+ * @func   : cx_ResetSession
+ * @brief  : empty the tree of a session, keeping the session, its buffers
+ *           and memory for the next tree
+ * @called : to build/decode a new packet with an encoder/decoder session
+ *           used earlier, instead of destroying it and creating a new one
+ * @input  : void *_cookie - pointer to a valid xml-context
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_ResetSession (void *_cookie);
 
 /**
  * @func   : cx_DestroySession
@@ -404,7 +1254,7 @@ cx_status_t cx_CreateSession (void **_cookie, char *name, char *uxs, uint32_t in
  * @output : none
  * @return : void
  */
-void cx_DestroySession (void *_cookie);
+CX_API void cx_DestroySession (void *_cookie);
 
 /**
  * @func   : cx_strerr
@@ -414,7 +1264,152 @@ void cx_DestroySession (void *_cookie);
  * @output : none
  * @return : pointer to string describing the error type
  */
-const char *cx_strerr (cx_status_t cx_st);
+CX_API const char *cx_strerr (cx_status_t cx_st);
+
+#if CX_USING_STATS
+/*Phases of decoding/encoding timed by cx_stats_t*/
+typedef enum {
+	CX_PHASE_DEC,       /*whole of a decoding, parallel phases included*/
+	CX_PHASE_DEC_SPLIT, /*finding chunks of a big document*/
+	CX_PHASE_DEC_CHUNK, /*decoding the chunks on worker pool*/
+	CX_PHASE_DEC_MERGE, /*stitching decoded chunks into the document*/
+	CX_PHASE_ENC,       /*whole of an encoding, sizing included*/
+	CX_PHASE_ENC_SIZE,  /*sizing parts of a big tree*/
+	CX_PHASE_INDEX,     /*building tag index on first lookup of a tree*/
+	CX_PHASE_MAX,
+} cx_phase_t;
+
+/**
+ * Counters of work done, all of them only grow
+ * decodes, encodes - decoding/encoding calls, failed ones included
+ * nodes - nodes created by decoder and builder APIs
+ * attrs - attrs parsed by decoder or added by builder APIs
+ * bytesScanned - bytes of xml strings decoded, streamed ones included
+ * bytesEncoded - bytes of xml strings encoded
+ * allocs, allocBytes - heap allocations and bytes asked for by them
+ * finds - lookups of elements by tag name, cx_GetAttrValue included
+ * visited - nodes and tag index entries those lookups looked at
+ * ns - nanoseconds spent in each cx_phase_t
+ */
+typedef struct cx_stats_s {
+	uint64_t            decodes;
+	uint64_t            encodes;
+	uint64_t            nodes;
+	uint64_t            attrs;
+	uint64_t            bytesScanned;
+	uint64_t            bytesEncoded;
+	uint64_t            allocs;
+	uint64_t            allocBytes;
+	uint64_t            finds;
+	uint64_t            visited;
+	uint64_t            ns[CX_PHASE_MAX];
+} cx_stats_t;
+
+/**
+ * @func   : cx_GetStats
+ * @brief  : gives counters of a session, or of the whole process
+ * @called : to see what the library is doing, e.g. for periodic metrics
+ * @input  : void *_cookie - pointer to a valid xml-context, NULL for totals
+ *                           of all sessions of all threads
+ * @output : cx_stats_t *stats - counters
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ * Session counters survive cx_ResetSession, so a reused session counts all
+ * its packets. Totals take in a session's counts at end of each of its
+ * decoding, encoding and lookup, and once it is reset or destroyed; so
+ * trees being built show up only then. Streaming sessions count towards
+ * totals only
+ */
+CX_API cx_status_t cx_GetStats (void *_cookie, cx_stats_t *stats);
+#endif /*CX_USING_STATS*/
+
+#if CX_USING_TRACE
+/**
+ * @func   : cx_TraceEnable
+ * @brief  : turn recording of decoder/encoder events into trace rings on
+ *           or off, for all threads
+ * @called : at any time, e.g. from a signal of an operator; tracing can be
+ *           left on in production, an event costs some nanoseconds
+ * @input  : int on - non-zero to record events, 0 to stop
+ * @output : none
+ * @return : void
+ * Each thread gets a ring of its last CX_TRACE_RING_SZ events on its first
+ * event; rings of exited threads are gone
+ */
+CX_API void cx_TraceEnable (int on);
+
+/**
+ * @func   : cx_TraceDump
+ * @brief  : write trace rings of all threads to a file, in the binary form
+ *           of cx_tracehdr_t; tools/cxml_tracedec renders it
+ * @called : on demand, e.g. when something looks wrong
+ * @input  : int fd - file descriptor open for writing
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ * Threads go on recording while their rings are dumped, events overwritten
+ * meanwhile are left out
+ */
+CX_API cx_status_t cx_TraceDump (int fd);
+
+/**
+ * @func   : cx_TraceDumpOnError
+ * @brief  : dump trace rings, as by cx_TraceDump, every time a decoding or
+ *           encoding fails while tracing is on
+ * @called : when failures of production traffic are to be looked into
+ * @input  : int fd - file descriptor open for writing, -1 to stop dumping
+ * @output : none
+ * @return : void
+ */
+CX_API void cx_TraceDumpOnError (int fd);
+#endif /*CX_USING_TRACE*/
+
+/**
+ * A cursor over elements with a tag name, owned by caller, e.g. on its
+ * stack; all its fields are private to cx_FindFirst/cx_FindNext
+ */
+typedef struct cx_iter_s {
+	void                *cookie;
+	const char          *name;
+	uint32_t            len;
+	uint32_t            symId;
+	uint32_t            top;
+	uint32_t            cur;
+	uint32_t            ent;
+	uint32_t            mode;
+} cx_iter_t;
+
+/**
+ * @func   : cx_FindFirst
+ * @brief  : start an iterator over elements with a tag name, in document
+ *           order, and give the first one; cx_FindNext gives the rest,
+ *           each going on from the last match, so all matches together
+ *           cost one walk of the tree (or subtree) at most
+ * @called : when every element with a tag is needed, not just the first
+ * @input  : cx_iter_t *it - iterator to start
+ *           void *_cookie - pointer to a valid xml-context
+ *           const char *name - tag name, which must outlive the iteration
+ *           cx_node_t *under - node to look below, its descendants only;
+ *                              NULL for whole tree
+ * @output : cx_iter_t *it - iterator at the first match
+ * @return : NULL - if no match found
+ *           !NULL - first element with the tag
+ *           Tree must not be changed till iteration is over; elements of
+ *           a lazy session are built one by one as they are reached
+ */
+CX_API cx_node_t *cx_FindFirst (cx_iter_t *it, void *_cookie, const char *name, cx_node_t *under);
+
+/**
+ * @func   : cx_FindNext
+ * @brief  : give next element with the tag of an iterator, after its last
+ *           match in document order
+ * @called : after cx_FindFirst, till it gives NULL
+ * @input  : cx_iter_t *it - iterator from cx_FindFirst
+ * @output : cx_iter_t *it - iterator at the match given
+ * @return : NULL - if no more matches, as for all later calls
+ *           !NULL - next element with the tag
+ */
+CX_API cx_node_t *cx_FindNext (cx_iter_t *it);
 
 #if CX_USING_TAG_ATTR
 /**
@@ -430,7 +1425,7 @@ const char *cx_strerr (cx_status_t cx_st);
  * @return : CX_SUCCESS on success
  *           non-zero value indicating type of failure
  */
-cx_status_t cx_GetAttrValue (void *_cookie, const char *tagName, const char *attrName, char *attrValue);
+CX_API cx_status_t cx_GetAttrValue (void *_cookie, const char *tagName, const char *attrName, char *attrValue);
 #endif
 
 #endif /*__CXML_API_H*/
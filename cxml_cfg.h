@@ -6,6 +6,21 @@
 #define CX_MAX_ENC_STR_SZ 2048
 #define CX_MAX_DEC_STR_SZ 3096
 
+/* Streaming (SAX) decoder has no limit on document size; memory it holds
+ * is bounded by nesting depth and size of a single tag/attr name or value
+ * that is split over fed chunks */
+#define CX_SAX_MAX_DEPTH    256
+#define CX_SAX_MAX_TOKEN_SZ CX_MAX_DEC_STR_SZ
+
+/* Per-session arena: first block is carved along with the cookie itself,
+ * further blocks double in size upto CX_ARENA_MAX_BLK_SZ */
+#define CX_ARENA_BLK_SZ     4096
+#define CX_ARENA_MAX_BLK_SZ (1024 * 1024)
+
+/* Nodes of first node table block, carved along with the cookie too;
+ * further blocks double in size. Must be a power of 2 */
+#define CX_NODE_BLK_SZ      32
+
 /* define as 1 if debug prints are needed in cxml_enc.c */
 #define CX_ENC_DBG_EN 0
 /* define as 0 if debug prints are needed in cxml_dec.c */
@@ -24,6 +39,66 @@
 #define CX_USING_CDATA    1
 #define CX_USING_INSTR    1
 #define CX_USING_TAG_ATTR 1
+/*decoder jumps between structural characters found by SSE2/AVX2 kernels*/
+#define CX_USING_SIMD     1
+/*tag/attr names are interned in a table shared by all sessions/threads*/
+#define CX_USING_SYMTAB   1
+/*cx_DecBatch decodes packets in parallel on a pool of worker threads*/
+#define CX_USING_POOL     1
+/*counters of work done, per session and process-wide, see cx_GetStats*/
+#define CX_USING_STATS    1
+/*per-thread binary trace of decoder/encoder events, see cx_TraceEnable*/
+#define CX_USING_TRACE    1
+/*CXDEC_LAZY decoding indexes elements only, nodes are built as looked up*/
+#define CX_USING_LAZY     1
+/*cx_DecPktFilter builds only subtrees a filter of tags/paths lets through*/
+#define CX_USING_FILTER   1
+/*cx_ReaderNext pulls events of an xml string one by one, builds no tree*/
+#define CX_USING_READER   1
+/*cx_QueryCompile makes path queries to run on trees or readers*/
+#define CX_USING_QUERY    1
+
+/* Symbol table holds upto CX_SYM_MAX names of upto CX_SYM_MAX_LEN characters,
+ * once full, new names are just kept per session; CX_SYM_SHARDS locks
+ * serialise insertions, lookups take no lock */
+#define CX_SYM_MAX        4096
+#define CX_SYM_MAX_LEN    64
+#define CX_SYM_SHARDS     16
+
+/*Most threads a batch runs on, calling thread included*/
+#define CX_POOL_MAX_THREADS 64
+
+/* cx_DecBuf splits bodies of documents of atleast CX_PAR_DEC_MIN_SZ bytes
+ * into CX_PAR_DEC_CHUNKS chunks per thread, none below CX_PAR_DEC_MIN_CHUNK
+ * bytes; smaller ones are not worth waking threads for */
+#define CX_PAR_DEC_MIN_SZ    (256 * 1024)
+#define CX_PAR_DEC_MIN_CHUNK (32 * 1024)
+#define CX_PAR_DEC_CHUNKS    4
+
+/* cx_EncBuf splits children of root of trees encoding to atleast
+ * CX_PAR_ENC_MIN_SZ bytes into CX_PAR_ENC_CHUNKS groups per thread */
+#define CX_PAR_ENC_MIN_SZ    (256 * 1024)
+#define CX_PAR_ENC_CHUNKS    4
+
+/* A filter holds upto CX_FILTER_MAX_TAGS tag names/paths; filtered decoding
+ * takes upto CX_FILTER_MAX_DEPTH nested elements, it keeps them on stack */
+#define CX_FILTER_MAX_TAGS   32
+#define CX_FILTER_MAX_DEPTH  256
+
+/* A reader keeps names of upto CX_READER_MAX_DEPTH open elements in itself,
+ * so it takes documents of any size in a constant, caller-owned space */
+#define CX_READER_MAX_DEPTH  256
+
+/* A query takes upto CX_QUERY_MAX_STEPS steps and CX_QUERY_MAX_ATTRS attr
+ * tests in all; on a tree it goes upto CX_QUERY_MAX_DEPTH nested elements,
+ * it keeps them on stack */
+#define CX_QUERY_MAX_STEPS   8
+#define CX_QUERY_MAX_ATTRS   16
+#define CX_QUERY_MAX_DEPTH   256
+
+/* Trace ring of each thread keeps its last CX_TRACE_RING_SZ events, 24 bytes
+ * each. Must be a power of 2 */
+#define CX_TRACE_RING_SZ     4096
 
 /*define the system relevant printf-or-alike function for logging here*/
 /*defaulting to gcc library's printf*/
@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <sys/mman.h>
 
 #include "cxml.h"
 #include "cxml_api.h"
@@ -12,7 +13,7 @@
 #endif
 
 /*NOTE: Refer/Update according to cx_status_t definition!*/
-const char *cx_ErrStr[] = {
+static const char *const cx_ErrStr[] = {
 	"Success",
 
 	/*Buffer/Pointer errors*/
@@ -36,7 +37,7 @@ const char *cx_ErrStr[] = {
 	"Invalid Attr Type",
 	"Attr Name Null Pointer",
 	"Attr Value Null Pointer",
-	"Attr Not Found"
+	"Attr Not Found",
 
 	/*Tag errors*/
 	"Invalid Tag",
@@ -49,51 +50,458 @@ const char *cx_ErrStr[] = {
 
 	/*Unidentified errors*/
 	"Unknown failure",
+
+	/*File errors*/
+	"File can't be opened/mapped",
+
+	/*Query errors*/
+	"Invalid query path",
 };
+#define CX_NUM_ERR_STR (sizeof (cx_ErrStr) / sizeof (cx_ErrStr[0]))
+_Static_assert (CX_NUM_ERR_STR == (CX_ERR_INVALID_QUERY + 1), \
+		"cx_ErrStr doesn't match cx_status_t");
+
+/*CX_SCAN_xxx class of each character, 0 for the ones no scan stops at*/
+const uint8_t _cx_CharClass[256] = {
+	['<'] = CX_SCAN_LT, ['>'] = CX_SCAN_GT, ['/'] = CX_SCAN_SLASH,
+	['='] = CX_SCAN_EQ, ['"'] = CX_SCAN_QUOT, ['\''] = CX_SCAN_APOS,
+	[' '] = CX_SCAN_SPACE, ['\t'] = CX_SCAN_SPACE, ['\n'] = CX_SCAN_SPACE,
+	['\r'] = CX_SCAN_SPACE, ['\0'] = CX_SCAN_NUL,
+};
+
+/**
+ * @func   : _cx_ArenaAlloc
+ * @brief  : bump-allocate memory from the arena of a session
+ * @called : for every node/attr/string that lives as long as the session
+ * @input  : cx_arena_t *arena - arena of the session
+ *           size_t nBytes - number of bytes required
+ * @output : none
+ * @return : NULL - Failure
+ *           !NULL - pointer aligned to CX_ARENA_ALIGN
+ */
+void *_cx_ArenaAlloc (cx_arena_t *arena, size_t nBytes)
+{
+	cx_arena_blk_t *blk = arena->head;
+	size_t off, bSize;
+
+	nBytes = CX_ALIGN_UP (nBytes, CX_ARENA_ALIGN);
+
+	if (blk) {
+		off = CX_ALIGN_UP ((uintptr_t)(blk->data + blk->used), \
+				CX_ARENA_ALIGN) - (uintptr_t)(blk->data + blk->used);
+		if ((blk->used + off + nBytes) <= blk->size) {
+			blk->used += off + nBytes;
+			return blk->data + blk->used - nBytes;
+		}
+	}
+
+	/*Current block is full, double up for the next one*/
+	bSize = blk ? (blk->size << 1) : CX_ARENA_BLK_SZ;
+	if (bSize > CX_ARENA_MAX_BLK_SZ) {
+		bSize = CX_ARENA_MAX_BLK_SZ;
+	}
+	if (bSize < (nBytes + CX_ARENA_ALIGN)) {
+		bSize = nBytes + CX_ARENA_ALIGN;
+	}
+
+	_cx_malloc (blk, sizeof (cx_arena_blk_t) + bSize);
+	if (!blk) {
+		return NULL;
+	}
+	CX_STAT_ALLOC (CX_ARENA_COOKIE (arena), sizeof (cx_arena_blk_t) + bSize);
+	cx_trace (ARENA_BLK, 0, 0, 0, (uint32_t)bSize, 0);
+	blk->size = bSize;
+	blk->next = arena->head;
+	arena->head = blk;
+
+	off = CX_ALIGN_UP ((uintptr_t)blk->data, CX_ARENA_ALIGN) - \
+		(uintptr_t)blk->data;
+	blk->used = off + nBytes;
+	cx_com_dbg ("arena: new block of %zu bytes\n", bSize);
+
+	return blk->data + off;
+}
+
+/**
+ * @func   : _cx_ArenaRelease
+ * @brief  : give back all blocks of an arena, except the embedded one
+ * @called : when the session owning the arena is destroyed
+ * @input  : cx_arena_t *arena - arena of the session
+ * @output : none
+ * @return : void
+ */
+void _cx_ArenaRelease (cx_arena_t *arena)
+{
+	cx_arena_blk_t *blk = arena->head, *next;
+
+	for (; blk; blk = next) {
+		next = blk->next;
+		if (blk != arena->embedded) {
+			free (blk);
+		}
+	}
+	arena->head = arena->embedded;
+	if (arena->head) {
+		arena->head->used = 0;
+		arena->head->next = NULL;
+	}
+}
+
+/**
+ * @func   : _cx_ArenaReset
+ * @brief  : make all memory of an arena free again, keeping its biggest
+ *           block so that next use of the session doesn't go to malloc
+ * @called : when a session is reset to be used for a new tree
+ * @input  : cx_arena_t *arena - arena of the session
+ * @output : none
+ * @return : void
+ */
+void _cx_ArenaReset (cx_arena_t *arena)
+{
+	cx_arena_blk_t *keep = arena->head, *blk, *next;
+
+	if (!keep) {
+		return;
+	}
+	/*blocks only grow, so head is the biggest; embedded one stays anyway*/
+	for (blk = keep->next; blk; blk = next) {
+		next = blk->next;
+		if (blk != arena->embedded) {
+			free (blk);
+		}
+	}
+	keep->next = NULL;
+	keep->used = 0;
+}
+
+/**
+ * @func   : _cx_Unmap
+ * @brief  : unmap the file a session of cx_DecFile has its xs in, if any
+ * @called : when a session is reset or destroyed, its tree is gone by then
+ * @input  : cx_cookie_t *cookie - session
+ * @output : none
+ * @return : void
+ */
+void _cx_Unmap (cx_cookie_t *cookie)
+{
+	if (cookie->map) {
+		munmap (cookie->map, cookie->mapLen);
+		cookie->mapLen = 0;
+		if (cookie->xs == cookie->map) { /*not yet encoded into own buffer*/
+			cookie->xs = NULL;
+		}
+		cookie->map = NULL;
+	}
+}
 
 /**
  * @func   : _cx_strndup
- * @brief  : safely duplicate a source string using length limits specified
- * @called : called to duplicate an existing string into a memory from heap
- * @input  : char *src - src string ptr
+ * @brief  : safely duplicate a source string into arena using length limits
+ * @called : called to duplicate an existing string into session memory
+ * @input  : cx_arena_t *arena - arena of the session owning the string
+ *           const char *src - src string ptr
  *           size_t maxLen - maximum allowed length to use during duplication
- *           char *dName - name to relate to duplicated buffer
  * @output : none
  * @return : NULL - Failure or for NULL src or 0 sized src
- *           < 0 - for different failure conditions
+ *           !NULL - NULL terminated copy of src
  */
-char *_cx_strndup (char *src, size_t maxLen, char *dName)
+char *_cx_strndup (cx_arena_t *arena, const char *src, size_t maxLen)
 {
 	char *dest = NULL;
-	size_t dLen, sLen;
-
-	if (src && ((sLen = strlen (src)) != 0)) {
+	size_t dLen;
 
-		dLen = ((sLen < maxLen) ? sLen : maxLen);
+	if (src && ((dLen = strnlen (src, maxLen)) != 0)) {
 
-		_cx_calloc (dest, dLen + 1); /*+1 for NULL char to end-string*/
+		dest = _cx_ArenaAlloc (arena, dLen + 1); /*+1 for NULL char*/
 
 		if (dest) {
-			strncpy (dest, src, dLen);
+			memcpy (dest, src, dLen);
+			dest[dLen] = '\0';
 		}
 	}
 
 	return dest;
 }
 
-#if CX_USING_TAG_ATTR
-static void destroyAttrList (cxn_attr_t **list)
+/**
+ * @func   : _cx_NewCookie
+ * @brief  : allocate a cookie along with the first block of its arena
+ * @called : when a new encoder/decoder session is set up
+ * @input  : const char *name - name of the session
+ * @output : none
+ * @return : NULL - Failure
+ *           !NULL - freshly initialised cookie
+ */
+cx_cookie_t *_cx_NewCookie (const char *name)
+{
+	cx_cookie_t *cookie;
+	size_t nodeOff = CX_ALIGN_UP (CX_ALIGN_UP (sizeof (cx_cookie_t), \
+				CX_ARENA_ALIGN) + sizeof (cx_arena_blk_t) + CX_ARENA_BLK_SZ, \
+			__alignof__ (cx_node_t));
+
+	/*Arena and node table hand out memory zeroed as needed, clear just the
+	 *headers*/
+	_cx_malloc (cookie, nodeOff + CX_NODE_BLK_SZ * sizeof (cx_node_t));
+	if (!cookie) {
+		return NULL;
+	}
+	memset (cookie, 0, CX_ALIGN_UP (sizeof (cx_cookie_t), CX_ARENA_ALIGN) + \
+			sizeof (cx_arena_blk_t));
+	CX_STAT_ALLOC (cookie, nodeOff + CX_NODE_BLK_SZ * sizeof (cx_node_t));
+
+	cookie->cxCode = CX_COOKIE_MAGIC;
+	strncpy (cookie->name, name ? name : "unknown", CX_COOKIE_NAMELEN - 1);
+
+	/*First arena block lives right after the cookie, saving a malloc*/
+	cookie->arena.embedded = (cx_arena_blk_t *)((char *)cookie + \
+			CX_ALIGN_UP (sizeof (cx_cookie_t), CX_ARENA_ALIGN));
+	cookie->arena.embedded->size = CX_ARENA_BLK_SZ;
+	cookie->arena.head = cookie->arena.embedded;
+
+	/*So is the first node table block, after the arena block*/
+	cookie->nodes.blk[0] = (cx_node_t *)((char *)cookie + nodeOff);
+	cookie->nodes.nBlks = 1;
+	cookie->nodes.nNodes = 1; /*index 0 is no node*/
+
+	return cookie;
+}
+
+/**
+ * @func   : _cx_NewNode
+ * @brief  : add a zero filled node at end of node table of a session
+ * @called : for every node of the tree, by decoder and encoder
+ * @input  : cx_cookie_t *cookie - session the node belongs to
+ * @output : none
+ * @return : NULL - Failure
+ *           !NULL - new node, its self index set; it never moves
+ */
+cx_node_t *_cx_NewNode (cx_cookie_t *cookie)
 {
-	cxn_attr_t *cur = *list, *prev;
-
-	do {
-		prev = cur;
-		_cx_free (cur->attrName);
-		_cx_free (cur->attrValue);
-		_cx_free (cur);
-	} while (NULL != (cur = prev->next));
+	cx_nodetbl_t *tbl = &cookie->nodes;
+	uint32_t idx = tbl->nNodes, k = CX_NODE_BLK (idx);
+	cx_node_t *node;
+
+	if (k >= tbl->nBlks) {
+		/*upto the last block is full, next one is twice as big*/
+		if ((k >= CX_NODE_MAX_BLKS) || (idx == UINT32_MAX)) {
+			return NULL;
+		}
+		_cx_malloc (tbl->blk[k], (sizeof (cx_node_t) * CX_NODE_BLK_SZ) << k);
+		if (!tbl->blk[k]) {
+			return NULL;
+		}
+		tbl->nBlks++;
+		CX_STAT_ALLOC (cookie, (sizeof (cx_node_t) * CX_NODE_BLK_SZ) << k);
+		cx_com_dbg ("nodes: block %u of %u nodes\n", k, CX_NODE_BLK_SZ << k);
+	}
+
+	tbl->nNodes++;
+	CX_STAT_ADD (cookie, nodes, 1);
+	node = _cx_Node (cookie, idx);
+	memset (node, 0, sizeof (cx_node_t));
+	node->self = idx;
+
+	return node;
+}
+
+/**
+ * @func   : _cx_NewNodes
+ * @brief  : add n nodes at end of node table of a session, leaving them
+ *           uninitialised
+ * @called : when nodes built elsewhere are to be copied in as a whole
+ * @input  : cx_cookie_t *cookie - session the nodes belong to
+ *           uint32_t n - number of nodes
+ * @output : none
+ * @return : 0 - Failure
+ *           !0 - index of first of the n nodes
+ */
+uint32_t _cx_NewNodes (cx_cookie_t *cookie, uint32_t n)
+{
+	cx_nodetbl_t *tbl = &cookie->nodes;
+	uint32_t first = tbl->nNodes, k;
+
+	if (!n || (n >= (UINT32_MAX - first))) {
+		return 0;
+	}
+	/*blocks upto the one holding last of them*/
+	for (k = tbl->nBlks; k <= (uint32_t)CX_NODE_BLK (first + n - 1); k++) {
+		if (k >= CX_NODE_MAX_BLKS) {
+			return 0;
+		}
+		_cx_malloc (tbl->blk[k], (sizeof (cx_node_t) * CX_NODE_BLK_SZ) << k);
+		if (!tbl->blk[k]) {
+			return 0;
+		}
+		tbl->nBlks++;
+		CX_STAT_ALLOC (cookie, (sizeof (cx_node_t) * CX_NODE_BLK_SZ) << k);
+	}
+	tbl->nNodes += n;
+
+	return first;
+}
+
+#define CX_TAGIDX_MIN_BUCKETS 64
+
+/*FNV-1a, tag names are short and this is cheap per byte*/
+static inline uint32_t tagHash (const char *name, uint32_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	}
+	return h;
+}
+
+static cx_tagent_t *tagIndexLookup (cx_cookie_t *cookie, const char *name, \
+		uint32_t len, uint32_t id, uint32_t hash)
+{
+	cx_tagidx_t *idx = &cookie->tagIdx;
+	cx_tagent_t *ent = idx->bucket[hash & (idx->nBuckets - 1)];
+	cx_node_t *first;
+
+	for (; ent; ent = ent->next) {
+		CX_STAT_ADD (cookie, visited, 1);
+		first = _cx_Node (cookie, ent->first);
+		if ((ent->hash == hash) && CX_NAME_EQ (first->symId, \
+					first->tagField, first->tagLen, id, name, len)) {
+			break;
+		}
+	}
+	return ent;
+}
+
+/*Double the buckets, old ones stay in arena till session ends*/
+static cx_status_t tagIndexGrow (cx_cookie_t *cookie)
+{
+	cx_tagidx_t *idx = &cookie->tagIdx;
+	cx_tagent_t **bucket, *ent, *nextEnt;
+	uint32_t nBuckets = idx->nBuckets ? (idx->nBuckets << 1) : \
+						CX_TAGIDX_MIN_BUCKETS;
+	uint32_t i;
+
+	_cx_acalloc (&cookie->arena, bucket, nBuckets * sizeof (cx_tagent_t *));
+	cx_alloc_rfail (bucket);
+
+	for (i = 0; i < idx->nBuckets; i++) {
+		for (ent = idx->bucket[i]; ent; ent = nextEnt) {
+			nextEnt = ent->next;
+			ent->next = bucket[ent->hash & (nBuckets - 1)];
+			bucket[ent->hash & (nBuckets - 1)] = ent;
+		}
+	}
+	idx->bucket = bucket;
+	idx->nBuckets = nBuckets;
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : _cx_TagIndexAdd
+ * @brief  : add a node to tag index of its session, after all the nodes
+ *           already there with the same tag
+ * @called : for every new element, once the index is built; a node being
+ *           added must follow all indexed ones in document order
+ * @input  : cx_cookie_t *cookie - session owning the node
+ *           cx_node_t *node - node just linked into the tree
+ * @output : none
+ * @return : void, on allocation failure the index is just dropped, so that
+ *           next lookup builds it again
+ */
+void _cx_TagIndexAdd (cx_cookie_t *cookie, cx_node_t *node)
+{
+	cx_tagidx_t *idx = &cookie->tagIdx;
+	cx_tagent_t *ent;
+	uint32_t hash;
+
+	if (!idx->bucket || !IS_ELEMENT (node)) {
+		return;
+	}
+
+	hash = tagHash (node->tagField, node->tagLen);
+	ent = tagIndexLookup (cookie, node->tagField, node->tagLen, \
+			node->symId, hash);
+	if (ent) {
+		_cx_Node (cookie, ent->last)->nextSame = node->self;
+		ent->last = node->self;
+		return;
+	}
+
+	if (((idx->nEntries >= idx->nBuckets) && \
+				(CX_SUCCESS != tagIndexGrow (cookie))) || \
+			_cx_acalloc (&cookie->arena, ent, sizeof (cx_tagent_t))) {
+		memset (idx, 0, sizeof (*idx));
+		return;
+	}
+	ent->hash = hash;
+	ent->first = ent->last = node->self;
+	ent->next = idx->bucket[hash & (idx->nBuckets - 1)];
+	idx->bucket[hash & (idx->nBuckets - 1)] = ent;
+	idx->nEntries++;
+}
+
+/*Index whole tree in document order, when it is searched the first time*/
+static cx_status_t tagIndexBuild (cx_cookie_t *cookie)
+{
+	cx_status_t xStatus;
+	cx_node_t *curNode = cookie->root;
+	uint32_t i;
+
+	cx_func_rfail (tagIndexGrow (cookie));
+
+	if (!cookie->nodes.unordered) {
+		/*table is in document order, no links to follow*/
+		for (i = 1; i < cookie->nodes.nNodes; i++) {
+			curNode = _cx_Node (cookie, i);
+			curNode->nextSame = 0;
+			_cx_TagIndexAdd (cookie, curNode);
+			cx_rfail (!cookie->tagIdx.bucket, CX_ERR_ALLOC);
+		}
+		CX_STAT_ADD (cookie, visited, cookie->nodes.nNodes - 1);
+		return CX_SUCCESS;
+	}
+
+	while (curNode) {
+		CX_STAT_ADD (cookie, visited, 1);
+		curNode->nextSame = 0;
+		_cx_TagIndexAdd (cookie, curNode);
+		cx_rfail (!cookie->tagIdx.bucket, CX_ERR_ALLOC);
+		if (curNode->children) {
+			curNode = _cx_Node (cookie, curNode->children);
+			continue;
+		}
+		/*no more children, climb till some node has a next one*/
+		while (curNode && !curNode->next) {
+			curNode = _cx_Node (cookie, curNode->parent);
+		}
+		if (curNode) {
+			curNode = _cx_Node (cookie, curNode->next);
+		}
+	}
+
+	return CX_SUCCESS;
+}
+
+/*Tag index of a session, built if it isn't yet*/
+static cx_status_t tagIndexReady (cx_cookie_t *cookie)
+{
+	cx_status_t xStatus;
+	uint64_t t0;
+
+	if (cookie->tagIdx.bucket) {
+		return CX_SUCCESS;
+	}
+	t0 = CX_STAT_NOW ();
+	xStatus = tagIndexBuild (cookie);
+	CX_STAT_PHASE (cookie, CX_PHASE_INDEX, t0);
+	cx_trace (INDEX, 0, xStatus, 0, cookie->nodes.nNodes - 1, 0);
+	if (xStatus != CX_SUCCESS) {
+		/*partially built index is of no use, start over next time*/
+		memset (&cookie->tagIdx, 0, sizeof (cookie->tagIdx));
+	}
+
+	return xStatus;
 }
-#endif
 
 /**
  * @func   : cx_FindNodeWithTag
@@ -103,34 +511,193 @@ static void destroyAttrList (cxn_attr_t **list)
  *           char *name - name of the tag for required node
  * @output : none
  * @return : NULL - if no match found
- *           !NULL - if node with specified tag is found
+ *           !NULL - first element with specified tag in document order
  */
 cx_node_t *cx_FindNodeWithTag (void *_cookie, char *name)
 {
 	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
-	cx_node_t *curNode = cookie->root;
+	cx_tagent_t *ent;
+	uint32_t len;
+#if CX_USING_LAZY
+	cx_node_t *node;
+	uint32_t e = 0;
+#endif
 
-	if (!curNode) {
+	if (!cookie || !name || (!cookie->root && !CX_LAZY_PENDING (cookie))) {
 		cx_com_dbg ("Can't have NULL to start with!");
 		return (cx_node_t *)NULL;
 	}
+	CX_STAT_ADD (cookie, finds, 1);
+	len = (uint32_t)strlen (name);
+
+#if CX_USING_LAZY
+	if (CX_LAZY_PENDING (cookie)) {
+		/*no tree to index yet, look in elements and build just the one*/
+		node = _cx_LazyFind (cookie, name, len, &e);
+		_cx_StatsFlush (cookie);
+		cx_trace (FIND, 0, node ? CX_SUCCESS : CX_ERR_NODE_NOT_FOUND, \
+				0, len, 0);
+		return node;
+	}
+#endif
 
-	while (curNode) {
- 	    cx_com_dbg ("check %s\n", curNode->tagField);
-		if (!strcmp (name, curNode->tagField))
+	if (CX_SUCCESS != tagIndexReady (cookie)) {
+		_cx_StatsFlush (cookie);
+		return (cx_node_t *)NULL;
+	}
+
+	ent = tagIndexLookup (cookie, name, len, _cx_SymFind (name, len), \
+			tagHash (name, len));
+	_cx_StatsFlush (cookie);
+	cx_trace (FIND, 0, ent ? CX_SUCCESS : CX_ERR_NODE_NOT_FOUND, 0, len, 0);
+
+ 	cx_com_dbg ("findNode: %s %s\r\n", name, ent ? "success" : "failed");
+
+	return ent ? _cx_Node (cookie, ent->first) : (cx_node_t *)NULL;
+}
+
+/*How a cx_iter_t goes to its next match; 0 being done, as a zeroed one is*/
+typedef enum {
+	ITER_DONE,
+	ITER_INDEX,     /*whole tree, along nextSame links of tag index*/
+	ITER_LAZY,      /*whole tree not built yet, along its structural index*/
+	ITER_RANGE,     /*subtree, a range of table in document order*/
+	ITER_LINKS,     /*subtree, along links as table is out of order*/
+} cx_itermode_t;
+
+/*Next match of an iterator after its last one, NULL once there's none*/
+static cx_node_t *iterStep (cx_iter_t *it)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)it->cookie;
+	cx_node_t *node = (cx_node_t *)NULL, *top;
+	cx_tagent_t *ent;
+	uint32_t i, end;
+
+	switch (it->mode) {
+#if CX_USING_LAZY
+	case ITER_LAZY:
+		if (CX_LAZY_PENDING (cookie)) {
+			node = _cx_LazyFind (cookie, it->name, it->len, &it->ent);
+			break;
+		}
+		/*tree got built meanwhile, last match is in it as it was*/
+		it->mode = ITER_INDEX;
+		return iterStep (it);
+#endif
+	case ITER_INDEX:
+		if (CX_SUCCESS != tagIndexReady (cookie)) {
+			break;
+		}
+		if (it->cur) {
+			node = _cx_Node (cookie, _cx_Node (cookie, it->cur)->nextSame);
 			break;
-		if (curNode->children) {
-			curNode = curNode->children;
-		} else { /*try list of children*/
-			/*If no more children, goto next node of parent, 
-			 *since parent is already checked*/
-			curNode = (curNode->next)?curNode->next:curNode->parent->next;
 		}
+		ent = tagIndexLookup (cookie, it->name, it->len, it->symId, \
+				tagHash (it->name, it->len));
+		node = ent ? _cx_Node (cookie, ent->first) : (cx_node_t *)NULL;
+		break;
+
+	case ITER_RANGE:
+		end = CX_NODE_END (cookie, _cx_Node (cookie, it->top));
+		for (i = it->cur + 1; i < end; i++) {
+			node = _cx_Node (cookie, i);
+			if (IS_ELEMENT (node) && CX_NAME_EQ (node->symId, \
+						node->tagField, node->tagLen, it->symId, it->name, it->len)) {
+				break;
+			}
+		}
+		CX_STAT_ADD (cookie, visited, i - it->cur);
+		node = (i < end) ? node : (cx_node_t *)NULL;
+		break;
+
+	case ITER_LINKS:
+		top = _cx_Node (cookie, it->top);
+		node = _cx_Node (cookie, it->cur);
+		while (1) {
+			if (node->children) {
+				node = _cx_Node (cookie, node->children);
+			} else {
+				/*no more children, climb till some node has a next one*/
+				while ((node != top) && !node->next) {
+					node = _cx_Node (cookie, node->parent);
+				}
+				if (node == top) {
+					node = (cx_node_t *)NULL;
+					break;
+				}
+				node = _cx_Node (cookie, node->next);
+			}
+			CX_STAT_ADD (cookie, visited, 1);
+			if (IS_ELEMENT (node) && CX_NAME_EQ (node->symId, \
+						node->tagField, node->tagLen, it->symId, it->name, it->len)) {
+				break;
+			}
+		}
+		break;
+
+	default:
+		break;
 	}
 
- 	cx_com_dbg ("findNode: %s %s\r\n", name, curNode?"success":"failed");
+	if (node) {
+		it->cur = node->self;
+	} else {
+		it->mode = ITER_DONE;
+	}
 
-	return curNode;
+	return node;
+}
+
+cx_node_t *cx_FindFirst (cx_iter_t *it, void *_cookie, const char *name, cx_node_t *under)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	cx_node_t *node;
+
+	if (!it) {
+		return (cx_node_t *)NULL;
+	}
+	memset (it, 0, sizeof (*it));
+	if (!cookie || !name || (!cookie->root && !CX_LAZY_PENDING (cookie))) {
+		cx_com_dbg ("Can't have NULL to start with!");
+		return (cx_node_t *)NULL;
+	}
+	CX_STAT_ADD (cookie, finds, 1);
+
+	it->cookie = cookie;
+	it->name = name;
+	it->len = (uint32_t)strlen (name);
+	it->symId = _cx_SymFind (name, it->len);
+	if (under) {
+		/*subtree of a node handed out is built, lazy session or not*/
+		it->top = it->cur = under->self;
+		it->mode = cookie->nodes.unordered ? ITER_LINKS : ITER_RANGE;
+	} else {
+		it->mode = CX_LAZY_PENDING (cookie) ? ITER_LAZY : ITER_INDEX;
+	}
+
+	node = iterStep (it);
+	_cx_StatsFlush (cookie);
+	cx_trace (FIND, 0, node ? CX_SUCCESS : CX_ERR_NODE_NOT_FOUND, 0, \
+			it->len, 0);
+
+	return node;
+}
+
+cx_node_t *cx_FindNext (cx_iter_t *it)
+{
+	cx_node_t *node;
+
+	if (!it || (it->mode == ITER_DONE)) {
+		return (cx_node_t *)NULL;
+	}
+
+	node = iterStep (it);
+	if (!node) {
+		/*steps are too cheap to flush each, iteration's work goes at end*/
+		_cx_StatsFlush ((cx_cookie_t *)it->cookie);
+	}
+
+	return node;
 }
 
 #if CX_USING_TAG_ATTR
@@ -139,6 +706,7 @@ cx_status_t cx_GetAttrValue (void *_cookie, const char *tagName, const char *att
 	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
 	cx_node_t *tagNode = cookie->root;
 	cxn_attr_t *attr;
+	uint32_t len, id;
 
 	cx_null_rfail (tagName);
 	cx_null_rfail (attrName);
@@ -147,9 +715,13 @@ cx_status_t cx_GetAttrValue (void *_cookie, const char *tagName, const char *att
 	tagNode = cx_FindNodeWithTag (cookie, (char *)tagName);
 	cx_rfail (!tagNode, CX_ERR_NODE_NOT_FOUND);
 
+	len = (uint32_t)strlen (attrName);
+	id = _cx_SymFind (attrName, len);
 	for (attr = tagNode->attrList; attr; attr = attr->next) {
-		if (!strcmp (attr->attrName, attrName)) {
-			strcpy (attrValue, attr->attrValue);
+		if (CX_NAME_EQ (attr->nameId, attr->attrName, attr->nameLen, \
+					id, attrName, len)) {
+			memcpy (attrValue, attr->attrValue, attr->valueLen);
+			attrValue[attr->valueLen] = '\0';
 			return CX_SUCCESS;
 		}
 	}
@@ -158,77 +730,20 @@ cx_status_t cx_GetAttrValue (void *_cookie, const char *tagName, const char *att
 }
 #endif
 
-/**
- * @func   : _cx_destroyTree
- * @brief  : destroys a given xml tree
- * @called : when this xml tree is no longer required
- * @input  : cx_cookie_t *cookie - pointer to select xml-context
- * @output : none
- * @return : void
- */
-static void _cx_destroyTree (cx_cookie_t *cookie)
-{
-	cx_node_t *curNode = cookie->root;
-
-	if (!curNode) {
-		return;
-	}
-
-	cx_com_dbg ("Destroying xml tree from: %s\r\n", curNode->tagField);
-
-	while (curNode) {
-		cx_com_dbg ("cur: %p:%s\n", curNode, curNode->tagField);
-		if (curNode->children) {
-			curNode = curNode->children;
-		} else {
-			cx_node_t *temp;
-			uint8_t isParent = 0;
-FREE_NODE:
-			if (curNode->next) {
-				temp = curNode->next;
-			} else {
-				temp = curNode->parent;
-				if (temp) {
-					isParent = 1;
-				}
-			}
-			cx_com_dbg ("freeing: %s\n", curNode->tagField);
-			_cx_free (curNode->tagField);
-#if CX_USING_TAG_ATTR
-			if (curNode->attrList) {
-				destroyAttrList (&(curNode->attrList));
-			}
-#endif
-			cx_com_dbg ("freeing: %p\r\n", curNode);
-			_cx_free (curNode);
-			if (isParent) { /*all children dead, so parent also dies*/
-				curNode = temp;
-				temp = temp->next;
-				isParent = 0;
-				goto FREE_NODE;
-			}
-			curNode = temp;
-		}
-	}
-	cookie->root = NULL;
-	cx_com_dbg ("destruction of the Tree complete\r\n");
-}
-
 cx_status_t cx_CreateSession (void **_cookie, char *name, char *uxs, uint32_t initXmlLength)
 {
 	cx_status_t xStatus = CX_SUCCESS;
 	cx_cookie_t *cookie;
 
 	cx_null_rfail (_cookie);
-	cx_rfail ((initXmlLength >= CX_MAX_ENC_STR_SZ), CX_ERR_ENC_OVERFLOW);
 
-	_cx_calloc (cookie, sizeof (cx_cookie_t));
-	cx_alloc_lfail (cookie);
+	cookie = _cx_NewCookie (name);
+	cx_alloc_rfail (cookie);
 
-	cookie->cxCode = CX_COOKIE_MAGIC;
-	strncpy (cookie->name, name ? name : "unknown", CX_COOKIE_NAMELEN);
 	if (uxs != NULL) {
-		cookie->uxsLength = initXmlLength;
+		/*Unknown size, user buffer is expected to fit the packet limit*/
+		cookie->uxsLength = initXmlLength ? initXmlLength : \
+							(CX_MAX_ENC_STR_SZ + 1);
 		cookie->xsIsFromUser = 1;
 		cookie->xs = uxs;
 	}
@@ -240,25 +755,50 @@ cx_status_t cx_CreateSession (void **_cookie, char *name, char *uxs, uint32_t in
 	 * */
 	*_cookie = cookie;
 
-CX_ERR_LBL:
-	if (xStatus != CX_SUCCESS) {
-		if (cookie->xsIsFromUser) {
-			_cx_free (cookie->xs);
-		}
-		_cx_free (cookie);
-	}
 	return xStatus;
 }
 
+void cx_ResetSession (void *_cookie)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+
+	if (cookie && (cookie->cxCode == CX_COOKIE_MAGIC)) {
+		/*xs and arena capacity are kept, only the tree goes*/
+		_cx_ArenaReset (&cookie->arena);
+		_cx_Unmap (cookie);
+		cookie->root = cookie->recent = NULL;
+		cookie->xmlLength = cookie->decLength = 0;
+		memset (&cookie->tagIdx, 0, sizeof (cookie->tagIdx));
+		cookie->nodes.nNodes = 1;
+		cookie->nodes.unordered = 0;
+#if CX_USING_LAZY
+		cookie->lazy.nEnts = 0;
+#endif
+		_cx_StatsFlush (cookie);
+	}
+}
+
 void cx_DestroySession (void *_cookie)
 {
 	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	uint32_t i;
 
 	if (cookie && (cookie->cxCode == CX_COOKIE_MAGIC)) {
+		_cx_StatsFlush (cookie);
 		if (!cookie->xsIsFromUser) {/*Library allocated xml-string? Free it!*/	
 			_cx_free (cookie->xs);
 		}
-		_cx_destroyTree (cookie);
+		_cx_Unmap (cookie);
+		/*Attrs and strings are in the arena, no need to walk the tree*/
+		_cx_ArenaRelease (&cookie->arena);
+		/*and nodes are in a few blocks*/
+		for (i = 1; i < cookie->nodes.nBlks; i++) {
+			_cx_free (cookie->nodes.blk[i]);
+		}
+#if CX_USING_LAZY
+		_cx_free (cookie->lazy.ent);
+#endif
+		cookie->root = cookie->recent = NULL;
 		cookie->cxCode = 0;
 		_cx_free (cookie);
 	}
@@ -266,7 +806,7 @@ void cx_DestroySession (void *_cookie)
 
 const char *cx_strerr (cx_status_t cx_st)
 {
-	if ((cx_st >= 0) && (cx_st <= CX_FAILURE)) {
+	if ((cx_st >= 0) && ((size_t)cx_st < CX_NUM_ERR_STR)) {
 		return cx_ErrStr[cx_st];
 	}
 
@@ -2,360 +2,1758 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cxml.h"
 #include "cxml_api.h"
 #include "cxml_errchk.h"
 
-#define SKIP_SPACES(ptr) while (ptr && isspace ((int)*ptr)) { ptr++; }
-#define SKIP_LETTERS(ptr) \
-	while (ptr && *ptr && \
-			!isspace ((int)*ptr) && (*ptr !='/') && (*ptr !='>')) { ptr++; }
+/**
+ * State of the single forward pass over an xml string
+ * cookie - session the tree is built for
+ * end - scanning never goes at or beyond this, even if no '\0' is seen
+ * isLimit - end is just the packet size limit, not the end of the string
+ * open - innermost PARENT node whose closing tag is still awaited
+ * last - last node at top level, next top level node follows it
+ * inBody - string is a chunk of an element's body, so its top level nodes
+ *          are that element's children, contents included
+ * start - first character of the whole xml string, traces give offsets
+ *         from it
+ * filter - elements to build or not, NULL to build all
+ */
+typedef struct cx_lexer_s {
+	cx_cookie_t         *cookie;
+	char                *end;
+	int                 isLimit;
+	cx_node_t           *open;
+	cx_node_t           *last;
+	int                 inBody;
+	char                *start;
+	const cx_filter_t   *filter;
+} cx_lexer_t;
 
-#define BET_TOKEN 0x01
-#define GET_TOKEN 0x02
-static inline char * findStrToken (char *str, const char *token, uint8_t checkType)
+/*Every scan stops at end of string: '\0' or lexer end, whichever is first*/
+#define LEX_EOI(lx, ptr) (((ptr) >= (lx)->end) || !*(ptr))
+
+#define IS_SPACE(c) (((c) == ' ') || ((c) == '\n') || \
+		((c) == '\t') || ((c) == '\r'))
+
+/*Names and small values end within a few characters, a scan running
+ *past that is likely long text, so it is handed over to block kernels*/
+#define SCAN_SHORT_LEN 16
+
+static inline char *scanTo (cx_lexer_t *lx, char *ptr, uint32_t classes)
 {
-	char *ptr = strstr (str, token);
+	char *lim = lx->end;
 
-	if ((!ptr) || (ptr == str)) {
-		return NULL;
+	classes |= CX_SCAN_NUL;
+#if CX_USING_SIMD
+	if ((lim - ptr) > SCAN_SHORT_LEN) {
+		lim = ptr + SCAN_SHORT_LEN;
 	}
-
-	if (checkType & BET_TOKEN) {
-		return (char *)!NULL;
+#endif
+	while ((ptr < lim) && !(_cx_CharClass[(uint8_t)*ptr] & classes)) {
+		ptr++;
+	}
+#if CX_USING_SIMD
+	if ((ptr == lim) && (ptr < lx->end)) {
+		ptr = _cx_ScanRun (ptr, lx->end, classes);
 	}
+#endif
+	return ptr;
+}
+#define SCAN_TO(lx, ptr, classes) scanTo (lx, ptr, classes)
+
+#define SKIP_SPACES(lx, ptr) \
+	while (((ptr) < (lx)->end) && IS_SPACE (*(ptr))) { (ptr)++; }
+
+#define SKIP_LETTERS(lx, ptr) \
+	(ptr) = SCAN_TO (lx, ptr, CX_SCAN_NAME_END)
+
+/*Lexing helpers shared by all passes are put right into each of them,
+ *so that the hot loop of every pass stays a single function*/
+#define LEX_INLINE inline __attribute__((always_inline))
 
-	return _cx_strndup (str, (size_t)(ptr - str), str);
+/*Nodes and attrs keep 32-bit lengths, a longer name or string fails with
+ *CX_ERR_DEC_OVERFLOW rather than be cut short, in every pass alike*/
+#define LEX_LEN_OK(len) ((uint64_t)(len) <= UINT32_MAX)
+
+/*An error at end of string is an overflow if the packet limit hit it*/
+#define lexEoiErr(lx, ptr, errCode) \
+	((((ptr) >= (lx)->end) && (lx)->isLimit) ? CX_ERR_DEC_OVERFLOW : errCode)
+
+/**
+ * @func   : findTagEnd
+ * @brief  : find end of a comment/cdata/instr tag, i.e. a '>' which is
+ *           preceded by the given tail, e.g. "--" for a comment
+ * @input  : cx_lexer_t *lx - lexer state
+ *           char *ptr - first character of tag contents
+ *           const char *tail - characters expected just before '>'
+ *           size_t tLen - number of characters in tail
+ * @output : none
+ * @return : pointer to first character of tail, end of string if not found
+ *           Each '>' is looked at only once, so the scan stays linear
+ */
+static char *findTagEnd (cx_lexer_t *lx, char *ptr, const char *tail, size_t tLen)
+{
+	char *start = ptr;
+
+	while (1) {
+		ptr = SCAN_TO (lx, ptr, CX_SCAN_GT);
+		if (LEX_EOI (lx, ptr)) {
+			return ptr;
+		}
+		if (((size_t)(ptr - start) >= tLen) && \
+				!memcmp (ptr - tLen, tail, tLen)) {
+			return ptr - tLen;
+		}
+		ptr++;
+	}
 }
 
-#define checkStrToken(str, token) findStrToken (str, token, BET_TOKEN)
-#define getStrToken(str, token) findStrToken (str, token, GET_TOKEN)
+/*Markup found at a '<' by lexTag*/
+typedef enum {
+	LEX_STAG,    /*start tag, its name*/
+	LEX_ETAG,    /*closing tag, its name*/
+	LEX_INSTR,   /*instruction, its contents*/
+	LEX_COMMENT, /*comment, its text*/
+	LEX_CDATA,   /*cdata, its contents*/
+} cx_lextag_t;
 
-#if CX_USING_TAG_ATTR
-static cx_status_t getNodeAttr (cx_node_t *xmlNode, char **tag)
+/**
+ * @func   : lexTag
+ * @brief  : find what markup a '<' starts and scan over it; a start tag is
+ *           scanned only upto end of its name, its attrs are left to caller
+ * @called : by every pass over an xml string, right after each '<'
+ * @input  : cx_lexer_t *lx - lexer state
+ *           char **_decPtr - character after '<'
+ * @output : char **_decPtr - character after the markup, or after name of
+ *                            a start tag
+ *           cx_lextag_t *kind - markup found
+ *           char **tPtr, size_t *tLen - name of a start/closing tag, or
+ *                                       contents of the others
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static LEX_INLINE cx_status_t lexTag (cx_lexer_t *lx, char **_decPtr, \
+		cx_lextag_t *kind, char **tPtr, size_t *tLen)
 {
-	cx_status_t xStatus = CX_SUCCESS;
-	cxn_attr_t *curAttr = NULL, *lastAttr = NULL;
-	char *ptr, *tPtr, *tEnd;
+	char *decPtr = *_decPtr;
 
-	cx_null_rfail (*tag);
+	cx_rfail (LEX_EOI (lx, decPtr), \
+			lexEoiErr (lx, decPtr, CX_ERR_INVALID_TAG));
 
-	tEnd = strchr (*tag, '>');
+	if (*decPtr == '/') {
+		/*should be a tag-closing: </tagName>*/
+		*tPtr = ++decPtr;
+		SKIP_LETTERS (lx, decPtr);
+		*tLen = (size_t)(decPtr - *tPtr);
+		SKIP_SPACES (lx, decPtr);
+		cx_rfail (LEX_EOI (lx, decPtr) || (*decPtr != '>'), \
+				lexEoiErr (lx, decPtr, CX_ERR_UNCLOSED_TAG));
+		*kind = LEX_ETAG;
+		decPtr++;
+	}
+#if CX_USING_INSTR
+	else if (*decPtr == '?') {
+		/*Instruction tag*/
+		*tPtr = ++decPtr;
+		decPtr = findTagEnd (lx, decPtr, "?", 1);
+		cx_rfail (LEX_EOI (lx, decPtr), \
+				lexEoiErr (lx, decPtr, CX_ERR_UNCLOSED_TAG));
+		*tLen = (size_t)(decPtr - *tPtr);
+		*kind = LEX_INSTR;
+		decPtr += 2;
+	}
+#endif
+#if CX_USING_COMMENTS
+	else if (((lx->end - decPtr) >= 3) && \
+			(CX_SUCCESS == strncmp (decPtr, "!--", 3))) {
+		/*Comment tag*/
+		decPtr += 3;
+		SKIP_SPACES (lx, decPtr);
+		*tPtr = decPtr;
+		decPtr = findTagEnd (lx, decPtr, "--", 2);
+		cx_rfail (LEX_EOI (lx, decPtr), \
+				lexEoiErr (lx, decPtr, CX_ERR_UNCLOSED_TAG));
+		*tLen = (size_t)(decPtr - *tPtr);
+		*kind = LEX_COMMENT;
+		decPtr += 3;
+	}
+#endif
+#if CX_USING_CDATA
+	else if (((lx->end - decPtr) >= 8) && \
+			(CX_SUCCESS == strncmp (decPtr, "![CDATA[", 8))) {
+		/*Cdata tag*/
+		decPtr += 8;
+		*tPtr = decPtr;
+		decPtr = findTagEnd (lx, decPtr, "]]", 2);
+		cx_rfail (LEX_EOI (lx, decPtr), \
+				lexEoiErr (lx, decPtr, CX_ERR_UNCLOSED_TAG));
+		*tLen = (size_t)(decPtr - *tPtr);
+		*kind = LEX_CDATA;
+		decPtr += 3;
+	}
+#endif
+	else {
+		/*Parent tag.. default*/
+		*tPtr = decPtr;
+		SKIP_LETTERS (lx, decPtr);
+		cx_rfail ((decPtr == *tPtr), \
+				lexEoiErr (lx, decPtr, CX_ERR_INVALID_TAG));
+		*tLen = (size_t)(decPtr - *tPtr);
+		*kind = LEX_STAG;
+	}
+	cx_rfail (!LEX_LEN_OK (*tLen), CX_ERR_DEC_OVERFLOW);
+	*_decPtr = decPtr;
 
-   	tEnd -= (*(tEnd-1) == '/');
-	
-	tPtr = *tag;
-	ptr = getStrToken (tPtr, "=");
-	if (!ptr) {
-		cx_dec_dbg ("No attributes for %s", xmlNode->tagField);
-		return CX_SUCCESS;
+	return CX_SUCCESS;
+}
+
+/*Past end of a start tag, its '>' or "/>" attrs stopped at; is it "/>"?*/
+static LEX_INLINE cx_status_t lexStagEnd (cx_lexer_t *lx, char **_decPtr, \
+		int *isSingle)
+{
+	char *decPtr = *_decPtr;
+
+	*isSingle = (*decPtr == '/');
+	if (*isSingle) {
+		/*might be a self-ending-tag*/
+		cx_rfail (((decPtr + 1) >= lx->end) || (decPtr[1] != '>'), \
+				lexEoiErr (lx, decPtr + 1, CX_ERR_INVALID_TAG));
+		decPtr++;
 	}
+	*_decPtr = decPtr + 1;
 
-	cx_dec_dbg ("finding attrs for %s", xmlNode->tagField);
-	do {
-		_cx_calloc (curAttr, sizeof (cxn_attr_t));
-		cx_alloc_rfail (curAttr);
+	return CX_SUCCESS;
+}
 
-		curAttr->attrName = ptr;
-		cx_dec_dbg ("attrName: %s", curAttr->attrName);
+/*In zero-copy mode strings are just views into the xml string itself*/
+static inline char *getDecStr (cx_cookie_t *cookie, char *src, size_t len)
+{
+	if (!len) {
+		return "";
+	}
+	if (cookie->decFlags & CXDEC_ZEROCOPY) {
+		return src;
+	}
+	return _cx_strndup (&cookie->arena, src, len);
+}
 
-		ptr = strchr (tPtr, '"');
-		cx_lfail ((!ptr) || (!strchr (ptr+1, '"')), CX_ERR_INVALID_XML);
+/* Tag/attr names get their symbol ID and point to the interned copy, unless
+ * they can't be interned or zero-copy mode keeps them as views anyway */
+static inline char *getDecName (cx_cookie_t *cookie, char *src, size_t len, \
+		uint32_t *id)
+{
+	const char *symName;
+	uint32_t symId = _cx_SymIntern (src, (uint32_t)len, &symName);
 
-		curAttr->attrValue = getStrToken (++ptr, "\"");
-		cx_lfail (!curAttr->attrValue, CX_ERR_NULL_ATTRVALUE);
+	*id = symId;
+	if (symId && !(cookie->decFlags & CXDEC_ZEROCOPY)) {
+		return (char *)symName;
+	}
+	return getDecStr (cookie, src, len);
+}
 
-		cx_dec_dbg ("attrValue: %s", curAttr->attrValue);
+static void populateNodeInTree (cx_lexer_t *lx, cx_node_t *curNode)
+{
+	cx_node_t *parent = lx->open;
 
-		if (!xmlNode->attrList) {
-			xmlNode->attrList = curAttr;
+	if (parent) {
+		if (!parent->children) {
+			parent->children = curNode->self;
 		} else {
-			lastAttr->next = curAttr;
+			_cx_Node (lx->cookie, parent->lastChild)->next = curNode->self;
 		}
-		lastAttr = curAttr;
+		parent->lastChild = curNode->self;
+		curNode->parent = parent->self;
+		cx_dec_dbg ("'%.*s' child to '%.*s'", curNode->tagLen, \
+				curNode->tagField, parent->tagLen, parent->tagField);
+	} else if (lx->last) {
+		lx->last->next = curNode->self;
+		lx->last = curNode;
+	} else {
+		lx->cookie->root = lx->last = curNode;
+	}
+}
 
-		xmlNode->numOfAttr++;
-		ptr = strchr (ptr, '"') + 1;
-		SKIP_SPACES(ptr);
-		tPtr = ptr;
-	} while ((tPtr < tEnd) && (NULL != (ptr = getStrToken (tPtr, "="))));
+static cx_status_t getNodeFromNewTag (cx_lexer_t *lx, cx_node_t **curNode, cxn_type_t nodeType, char *str, size_t len)
+{
+	cx_node_t *node;
 
-	cx_dec_dbg (" End of attr list for: %s", xmlNode->tagField);
-	*tag = tEnd;
+	cx_rfail (!LEX_LEN_OK (len), CX_ERR_DEC_OVERFLOW);
+	/*nodes go in document order, so node table stays in it*/
+	node = _cx_NewNode (lx->cookie);
+	cx_alloc_rfail (node);
 
-CX_ERR_LBL:
-	if (xStatus != CX_SUCCESS) {
-		_cx_free (curAttr->attrName);
-		_cx_free (curAttr->attrValue);
-		_cx_free (curAttr);
+	if ((nodeType == CXN_PARENT) || (nodeType == CXN_SINGLE)) {
+		uint32_t symId;
+		node->tagField = getDecName (lx->cookie, str, len, &symId);
+		node->symId = symId;
+	} else {
+		node->tagField = getDecStr (lx->cookie, str, len);
 	}
-	return xStatus;
+	cx_alloc_rfail (node->tagField);
+	node->tagLen = (uint32_t)len;
+	node->nodeType = nodeType;
+	cx_trace (DEC_NODE, nodeType, 0, (uint32_t)(str - lx->start), \
+			(uint32_t)len, 0);
+	if (nodeType != CXN_PARENT) {
+		node->end = node->self + 1;
+	}
+
+	populateNodeInTree (lx, node);
+	*curNode = node;
+
+	return CX_SUCCESS;
 }
-#endif
 
-static void populateNodeInTree (cx_node_t *prevNode, cx_node_t *curNode)
+/**
+ * @func   : lexAttr
+ * @brief  : scan an attribute of a start tag, name="value" or name='value'
+ * @input  : cx_lexer_t *lx - lexer state
+ *           char **_decPtr - first character of attribute name
+ * @output : char **_decPtr - character after closing quote of its value
+ *           char **name, size_t *nameLen - attribute name
+ *           char **value, size_t *valueLen - attribute value, no quotes
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static LEX_INLINE cx_status_t lexAttr (cx_lexer_t *lx, char **_decPtr, \
+		char **name, size_t *nameLen, char **value, size_t *valueLen)
 {
-	if (prevNode) {
-		if (prevNode->nodeType == CXN_PARENT) {
-			if (!prevNode->children) {
-				prevNode->children = curNode;
-			} else {
-				prevNode->lastChild->next = curNode;
-			}
-			prevNode->lastChild = curNode;
-			curNode->parent = prevNode;
-			cx_dec_dbg ("'%s' child to '%s'", \
-					curNode->tagField, curNode->parent->tagField);
+	char *decPtr = *_decPtr;
+
+	*name = decPtr;
+	SKIP_LETTERS (lx, decPtr);
+	cx_rfail ((decPtr == *name), CX_ERR_NULL_ATTRNAME);
+	*nameLen = (size_t)(decPtr - *name);
+	SKIP_SPACES (lx, decPtr);
+	cx_rfail (LEX_EOI (lx, decPtr) || (*decPtr != '='), \
+			lexEoiErr (lx, decPtr, CX_ERR_INVALID_XML));
+	decPtr++;
+	SKIP_SPACES (lx, decPtr);
+	cx_rfail (LEX_EOI (lx, decPtr) || \
+			((*decPtr != '"') && (*decPtr != '\'')), \
+			lexEoiErr (lx, decPtr, CX_ERR_NULL_ATTRVALUE));
+	*value = decPtr + 1;
+	decPtr = SCAN_TO (lx, *value, \
+			(*decPtr == '"') ? CX_SCAN_QUOT : CX_SCAN_APOS);
+	cx_rfail (LEX_EOI (lx, decPtr), \
+			lexEoiErr (lx, decPtr, CX_ERR_INVALID_XML));
+	*valueLen = (size_t)(decPtr - *value);
+	cx_rfail (!LEX_LEN_OK (*nameLen) || !LEX_LEN_OK (*valueLen), \
+			CX_ERR_DEC_OVERFLOW);
+	*_decPtr = decPtr + 1; /*skip closing quote*/
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : getNodeAttr
+ * @brief  : parse attributes of a start tag upto its '>' or '/>'
+ * @input  : cx_lexer_t *lx - lexer state
+ *           cx_node_t *xmlNode - node the start tag belongs to, NULL to
+ *                                just find end of the tag
+ *           char **_decPtr - first character after tag name
+ * @output : char **_decPtr - points to '>' or '/' ending the tag
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t getNodeAttr (cx_lexer_t *lx, cx_node_t *xmlNode, char **_decPtr)
+{
+	cx_status_t xStatus;
+	char *decPtr = *_decPtr, *name, *value;
+	size_t nameLen, valueLen;
+#if CX_USING_TAG_ATTR
+	cxn_attr_t *curAttr, *lastAttr = NULL;
+	uint32_t symId;
+#endif
+
+	while (1) {
+		SKIP_SPACES (lx, decPtr);
+		cx_rfail (LEX_EOI (lx, decPtr), \
+				lexEoiErr (lx, decPtr, CX_ERR_UNCLOSED_TAG));
+		if ((*decPtr == '>') || (*decPtr == '/')) {
+			break;
+		}
+
+		cx_func_rfail (lexAttr (lx, &decPtr, &name, &nameLen, \
+					&value, &valueLen));
+		if (!xmlNode) {
+			continue;
+		}
+
+#if CX_USING_TAG_ATTR
+		_cx_acalloc (&lx->cookie->arena, curAttr, sizeof (cxn_attr_t));
+		cx_alloc_rfail (curAttr);
+
+		curAttr->nameLen = (uint32_t)nameLen;
+		curAttr->attrName = getDecName (lx->cookie, name, curAttr->nameLen, \
+				&symId);
+		curAttr->nameId = symId;
+		curAttr->valueLen = (uint32_t)valueLen;
+		curAttr->attrValue = getDecStr (lx->cookie, value, curAttr->valueLen);
+		cx_rfail (!curAttr->attrName || !curAttr->attrValue, CX_ERR_ALLOC);
+		cx_dec_dbg ("attr: %.*s=%.*s", curAttr->nameLen, curAttr->attrName, \
+				curAttr->valueLen, curAttr->attrValue);
+
+		if (!lastAttr) {
+			xmlNode->attrList = curAttr;
 		} else {
-			prevNode->next = curNode;
-			prevNode->parent->lastChild = curNode;
-			curNode->parent = prevNode->parent;
-			cx_dec_dbg ("'%s' next to '%s'", \
-					prevNode->next->tagField, prevNode->tagField);
+			lastAttr->next = curAttr;
 		}
+		xmlNode->lastAttr = lastAttr = curAttr;
+		xmlNode->numOfAttr++;
+		CX_STAT_ADD (lx->cookie, attrs, 1);
+		cx_trace (DEC_ATTR, 0, 0, (uint32_t)(name - lx->start), \
+				curAttr->valueLen, 0);
+#endif
 	}
+
+	*_decPtr = decPtr;
+
+	return CX_SUCCESS;
 }
 
-static cx_status_t getNodeFromNewTag (cx_node_t *prevNode, cx_node_t **curNode, cxn_type_t nodeType, char **_decPtr)
+/**
+ * @func   : lexRun
+ * @brief  : build nodes of all tags/contents upto end of string
+ * @called : by cx_BuildTreeFromXmlString, for the whole xml string or a part
+ *           of it, and for each chunk of a parallel decoding
+ * @input  : cx_lexer_t *lx - lexer state
+ *           char **_decPtr - first character to look at
+ * @output : char **_decPtr - end of string reached
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ *           Each byte is looked at a bounded number of times and every scan
+ *           is limited by the tag it belongs to, so it is O(length)
+ */
+static cx_status_t lexRun (cx_lexer_t *lx, char **_decPtr)
 {
-	char *decPtr = *_decPtr;
-	char *tPtr = decPtr;
-	char *tagField = NULL;
-	cx_status_t xStatus = CX_SUCCESS;
+	cx_status_t xStatus;
+	cx_node_t *curNode = NULL;
+	char *decPtr = *_decPtr, *tPtr;
+	cx_lextag_t kind;
+	size_t tLen;
+	int isSingle;
 
-	/*we dont need check CXN_SINGLE, since it gets updated when '/>' comes*/
-	/*after use set decPtr to '>' for other than PARENT;
-	 *in PARENT point next to tagName
-	 *for content, point to next tag opening*/
-	switch (nodeType) {
-		case CXN_PARENT:
-			cx_dec_dbg ("PARENT: %s", decPtr);
-			SKIP_LETTERS(decPtr); /*skip upto end of tag name*/
-			cx_rfail (!decPtr, CX_ERR_INVALID_TAG);
-			/*copy name to tagField*/
-			tagField = _cx_strndup (tPtr, \
-					(size_t)(decPtr - tPtr), "Parent");
+	while (1) {
+		SKIP_SPACES (lx, decPtr);
+		if (LEX_EOI (lx, decPtr)) {
 			break;
-#if CX_USING_COMMENTS
-		case CXN_COMMENT:
-			cx_dec_dbg ("COMMENT: %s", decPtr);
-			tagField = getStrToken (decPtr, "-->");
-			decPtr = strstr (decPtr, "-->") + 2;
+		}
+
+		if (*decPtr != '<') {
+			/*we have a content of parent now.. not a child*/
+			cx_rfail (!lx->open && !lx->inBody, CX_ERR_INVALID_XML);
+			tPtr = decPtr;
+			decPtr = SCAN_TO (lx, decPtr, CX_SCAN_LT);
+			cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_CONTENT, \
+						tPtr, (size_t)(decPtr - tPtr)));
+			cx_dec_dbg ("content: %.*s", curNode->tagLen, curNode->tagField);
+			continue;
+		}
+
+		decPtr++;
+		cx_func_rfail (lexTag (lx, &decPtr, &kind, &tPtr, &tLen));
+
+		switch (kind) {
+		case LEX_ETAG:
+			cx_rfail (!lx->open, CX_ERR_LONE_TAG);
+			cx_rfail ((lx->open->tagLen != tLen) || \
+					(CX_SUCCESS != memcmp (lx->open->tagField, tPtr, tLen)), \
+					CX_ERR_CLOSED_TAG_MISMATCH);
+			cx_dec_dbg ("NODE FULL: %.*s", lx->open->tagLen, \
+					lx->open->tagField);
+			lx->open->end = lx->cookie->nodes.nNodes;
+			lx->open = _cx_Node (lx->cookie, lx->open->parent);
 			break;
-#endif
-#if CX_USING_CDATA
-		case CXN_CDATA:
-			cx_dec_dbg ("CDATA: %s", decPtr);
-			tagField = getStrToken (decPtr, "]]>");
-			decPtr = strstr (decPtr, "]]>") + 2;
+		case LEX_INSTR:
+			/*Instruction tag, just discard it for now*/
+			cx_dec_dbg ("Skipping INSTR type node for now..");
 			break;
-#endif
-#if CX_USING_INSTR
-		case CXN_INSTR:
-			cx_dec_dbg ("INSTR: %s", decPtr);
-			tagField = getStrToken (decPtr, "?>");
-			/*We want decPtr at '>' for now -FIXME*/
-			decPtr = strstr (decPtr, "?>") + 1;
-#if 1
-			/*Just discard any allocations in case it's INSTR tag for now!*/
-			*_decPtr = decPtr;
-			_cx_free (tagField);
-			return CX_SUCCESS;
-#else
-			/*Fill-up xml version and parsing details -TODO*/
-#endif
+		case LEX_COMMENT:
+			cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_COMMENT, \
+						tPtr, tLen));
 			break;
-#endif
-		case CXN_CONTENT:
-			cx_dec_dbg ("CONTENT: %s", decPtr);
-			tagField = getStrToken (decPtr, "<");
-			decPtr = strchr (decPtr, '<');
+		case LEX_CDATA:
+			cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_CDATA, \
+						tPtr, tLen));
 			break;
-		case CXN_SINGLE: /*we won't have this ever, but have fail-safe*/
+		case LEX_STAG:
+			cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_PARENT, \
+						tPtr, tLen));
+			cx_dec_dbg ("node: %.*s", curNode->tagLen, curNode->tagField);
+
+			/*if we have attributes, get them*/
+			cx_func_rfail (getNodeAttr (lx, curNode, &decPtr));
+			cx_func_rfail (lexStagEnd (lx, &decPtr, &isSingle));
+			if (isSingle) {
+				curNode->nodeType = CXN_SINGLE;
+				curNode->end = curNode->self + 1;
+				cx_dec_dbg ("single node: %.*s", \
+						curNode->tagLen, curNode->tagField);
+			} else {
+				/*this parent might have children/content/both*/
+				lx->open = curNode;
+			}
 			break;
-		case CXN_MAX:
-		default:
-			cx_dec_dbg ("Invalid tag type!");
-			return CX_ERR_INVALID_TAG;
+		}
 	}
 
-	cx_null_rfail (tagField);
-	cx_rfail (!decPtr, CX_ERR_INVALID_TAG);
+	*_decPtr = decPtr;
 
-	_cx_calloc ((*curNode), sizeof (cx_node_t));
-	cx_alloc_rfail (*curNode);
+	return CX_SUCCESS;
+}
 
-	(*curNode)->tagField = tagField;
-	(*curNode)->nodeType = nodeType;
-	*_decPtr = decPtr;
+#if CX_USING_POOL
+/**
+ * Part of an element's body decoded on its own, in a session of its own
+ * start, end - xml string of the chunk, it starts and ends between two
+ *              top level tags/contents of the body
+ * cookie - session holding nodes of the chunk till they are copied over
+ * first, last - first/last top level node of the chunk, 0 if none
+ * base - index node 1 of the chunk gets in the document's node table
+ * xStatus - status of decoding the chunk
+ */
+typedef struct cx_chunk_s {
+	char                *start;
+	char                *end;
+	cx_cookie_t         *cookie;
+	uint32_t            first;
+	uint32_t            last;
+	uint32_t            base;
+	cx_status_t         xStatus;
+} cx_chunk_t;
 
-	populateNodeInTree (prevNode, *curNode);
+/**
+ * A document decoded in parallel
+ * lx - lexer of the document
+ * split - element whose body is decoded in chunks
+ * chunk - nChunks chunks of body of split element, room for maxChunks
+ */
+typedef struct cx_pardec_s {
+	cx_lexer_t          *lx;
+	cx_node_t           *split;
+	cx_chunk_t          *chunk;
+	uint32_t            nChunks;
+	uint32_t            maxChunks;
+} cx_pardec_t;
 
-	return xStatus;
+/**
+ * @func   : preIndex
+ * @brief  : find the first top level element with a body big enough to be
+ *           split, and split its body into chunks of atleast chunkSz bytes
+ *           between its child tags/contents; nothing is built
+ * @called : by decParallel before any node of the document is built
+ * @input  : cx_lexer_t *lx - lexer state of the document
+ *           char *decPtr - first '<' of the xml string
+ *           size_t chunkSz - least size of a chunk
+ *           cx_pardec_t *pd - chunk has room for maxChunks chunks
+ * @output : cx_pardec_t *pd - chunks found, atleast 2
+ *           char **bodyStart, **bodyEnd - body of the element
+ * @return : CX_SUCCESS if chunks are found
+ *           non-zero value otherwise, e.g. document is broken or none of its
+ *           elements is big enough
+ *           Tags are taken just like lexRun does, so a chunk starts at the
+ *           same place a single pass over the document would reach with
+ *           only the element open
+ */
+static cx_status_t preIndex (cx_lexer_t *lx, char *decPtr, size_t chunkSz, \
+		cx_pardec_t *pd, char **bodyStart, char **bodyEnd)
+{
+	cx_status_t xStatus;
+	char *tPtr, *ltPtr;
+	cx_lextag_t kind;
+	size_t tLen;
+	int isSingle;
+	uint32_t depth = 0;
+	cx_chunk_t *cur = NULL;
+
+	while (1) {
+		SKIP_SPACES (lx, decPtr);
+		cx_rfail (LEX_EOI (lx, decPtr), CX_ERR_UNCLOSED_TAG);
+
+		/*between two child tags/contents of element being split*/
+		if (cur && (depth == 1) && ((size_t)(decPtr - cur->start) >= \
+					chunkSz) && (pd->nChunks < pd->maxChunks)) {
+			cur->end = decPtr;
+			cur = &pd->chunk[pd->nChunks++];
+			cur->start = decPtr;
+		}
+
+		if (*decPtr != '<') {
+			cx_rfail (!depth, CX_ERR_INVALID_XML);
+			decPtr = SCAN_TO (lx, decPtr, CX_SCAN_LT);
+			continue;
+		}
+
+		ltPtr = decPtr++;
+		cx_func_rfail (lexTag (lx, &decPtr, &kind, &tPtr, &tLen));
+
+		if (kind == LEX_ETAG) {
+			cx_rfail (!depth, CX_ERR_LONE_TAG);
+			if (!--depth) {
+				if (pd->nChunks > 1) {
+					cur->end = *bodyEnd = ltPtr;
+					return CX_SUCCESS;
+				}
+				/*too small to split, look for a next one*/
+				pd->nChunks = 0;
+				cur = NULL;
+			}
+		} else if (kind == LEX_STAG) {
+			cx_func_rfail (getNodeAttr (lx, NULL, &decPtr));
+			cx_func_rfail (lexStagEnd (lx, &decPtr, &isSingle));
+			if (!isSingle && !depth++) {
+				/*a top level element, split its body if it's big*/
+				cur = &pd->chunk[0];
+				pd->nChunks = 1;
+				cur->start = *bodyStart = decPtr;
+			}
+		}
+	}
 }
 
-static cx_status_t cx_BuildTreeFromXmlString (cx_cookie_t *cookie)
+/*Build nodes of a chunk in a session of its own*/
+static void chunkDecode (void *arg, uint32_t i)
+{
+	cx_pardec_t *pd = (cx_pardec_t *)arg;
+	cx_chunk_t *ch = &pd->chunk[i];
+	cx_lexer_t lx = {
+		.end = ch->end,
+		.inBody = 1,
+		.start = pd->lx->start,
+	};
+	char *decPtr = ch->start;
+
+	lx.cookie = ch->cookie = _cx_NewCookie ("chunk");
+	if (!ch->cookie) {
+		ch->xStatus = CX_ERR_ALLOC;
+		return;
+	}
+	ch->cookie->decFlags = pd->lx->cookie->decFlags;
+	/*strings go in blocks of their own, to be handed over to document*/
+	ch->cookie->arena.head = NULL;
+
+	ch->xStatus = lexRun (&lx, &decPtr);
+	if ((ch->xStatus == CX_SUCCESS) && lx.open) {
+		ch->xStatus = CX_ERR_UNCLOSED_TAG;
+	}
+	ch->first = ch->cookie->root ? ch->cookie->root->self : 0;
+	ch->last = lx.last ? lx.last->self : 0;
+	cx_trace (DEC_CHUNK, 0, ch->xStatus, (uint32_t)(ch->start - lx.start), \
+			(uint32_t)(ch->end - ch->start), i);
+}
+
+#define CHUNK_IDX(idx, off) ((idx) ? ((idx) + (off)) : 0)
+
+/*Copy nodes of a chunk to document's node table, after the ones before*/
+static void chunkCopy (void *arg, uint32_t i)
+{
+	cx_pardec_t *pd = (cx_pardec_t *)arg;
+	cx_chunk_t *ch = &pd->chunk[i];
+	cx_cookie_t *doc = pd->lx->cookie;
+	uint32_t n, off = ch->base - 1;
+	cx_node_t *src, *dst;
+
+	for (n = 1; n < ch->cookie->nodes.nNodes; n++) {
+		src = _cx_Node (ch->cookie, n);
+		dst = _cx_Node (doc, n + off);
+		*dst = *src;
+		dst->self = src->self + off;
+		/*top level nodes of a chunk are children of split element*/
+		dst->parent = src->parent ? (src->parent + off) : pd->split->self;
+		dst->children = CHUNK_IDX (src->children, off);
+		dst->lastChild = CHUNK_IDX (src->lastChild, off);
+		dst->next = CHUNK_IDX (src->next, off);
+		dst->end = CHUNK_IDX (src->end, off);
+	}
+}
+
+/*Give arena blocks of a chunk to the document, just behind its head*/
+static void chunkArenaMove (cx_arena_t *doc, cx_arena_t *chunk)
+{
+	cx_arena_blk_t *tail = chunk->head;
+
+	if (!tail) {
+		return;
+	}
+	while (tail->next) {
+		tail = tail->next;
+	}
+	tail->next = doc->head->next;
+	doc->head->next = chunk->head;
+	chunk->head = chunk->embedded;
+}
+
+/**
+ * @func   : decParallel
+ * @brief  : decode a big document upto the closing tag of its first big
+ *           element, whose body is split into chunks decoded by the worker
+ *           pool, each in a session of its own, and then stitched into
+ *           the document in order
+ * @called : by cx_BuildTreeFromXmlString for big xml strings of known length
+ * @input  : cx_lexer_t *lx - lexer state, set up with session
+ *           char **_decPtr - first '<' of the xml string
+ *           uint32_t nThreads - most threads to use, 0 for one per cpu
+ * @output : char **_decPtr - closing tag of split element, which is still
+ *                            open in lexer state; a single pass takes it on
+ * @return : CX_SUCCESS on success
+ *           non-zero value if the document can't be split or is broken; tree
+ *           may be partly built then
+ *           Tree is just the same as a single pass builds, nodes included
+ */
+static cx_status_t decParallel (cx_lexer_t *lx, char **_decPtr, \
+		uint32_t nThreads)
 {
-	cx_node_t *curNode = NULL;
-	cx_node_t *prevNode = NULL;
-	char *decPtr = cookie->xs;
 	cx_status_t xStatus = CX_SUCCESS;
-	size_t tLen;
+	cx_cookie_t *doc = lx->cookie;
+	cx_pardec_t pd = { .lx = lx };
+	cx_chunk_t *ch;
+	char *decPtr = *_decPtr, *end = lx->end, *bodyStart = NULL, *bodyEnd = NULL;
+	size_t chunkSz;
+	uint32_t i, base, nNodes;
+	uint64_t t0;
 
-NEW_TAG:
-	SKIP_SPACES(decPtr);
-	if (*decPtr == '<') {
-		cxn_type_t type;
-		decPtr++;
-		if (*decPtr == '/') {
-			char *ptr, *tName;
+	nThreads = _cx_PoolThreads (nThreads);
+	chunkSz = (size_t)(end - decPtr) / (nThreads * CX_PAR_DEC_CHUNKS);
+	if (chunkSz < CX_PAR_DEC_MIN_CHUNK) {
+		chunkSz = CX_PAR_DEC_MIN_CHUNK;
+	}
+	pd.maxChunks = (uint32_t)((size_t)(end - decPtr) / chunkSz) + 1;
+	_cx_calloc (pd.chunk, pd.maxChunks * sizeof (cx_chunk_t));
+	cx_alloc_rfail (pd.chunk);
+	CX_STAT_ALLOC (doc, pd.maxChunks * sizeof (cx_chunk_t));
 
-			/*should be a tag-closing: </tagName>*/
-			decPtr++;
+	t0 = CX_STAT_NOW ();
+	xStatus = preIndex (lx, decPtr, chunkSz, &pd, &bodyStart, &bodyEnd);
+	CX_STAT_PHASE (doc, CX_PHASE_DEC_SPLIT, t0);
+	cx_func_lfail (xStatus);
+	cx_trace (DEC_SPLIT, 0, 0, 0, (uint32_t)chunkSz, pd.nChunks);
 
-			ptr = strchr (decPtr, '>');
-			cx_rfail (!ptr, CX_ERR_UNCLOSED_TAG);
+	/*whatever is before the body, start tag of split element being last*/
+	lx->end = bodyStart;
+	xStatus = lexRun (lx, &decPtr);
+	lx->end = end;
+	cx_func_lfail (xStatus);
+	pd.split = lx->open;
+	cx_null_lfail (pd.split);
 
-			cx_rfail (!prevNode, CX_ERR_INVALID_TAG);
+	t0 = CX_STAT_NOW ();
+	_cx_PoolRun (chunkDecode, &pd, pd.nChunks, nThreads);
+	CX_STAT_PHASE (doc, CX_PHASE_DEC_CHUNK, t0);
+	t0 = CX_STAT_NOW ();
+	for (i = 0, nNodes = 0; i < pd.nChunks; i++) {
+		ch = &pd.chunk[i];
+		cx_func_lfail (ch->xStatus);
+		cx_lfail ((nNodes >= (UINT32_MAX - ch->cookie->nodes.nNodes)), \
+				CX_ERR_ALLOC);
+		ch->base = nNodes;
+		nNodes += ch->cookie->nodes.nNodes - 1;
+	}
 
-			if (curNode->nodeType == CXN_PARENT) {
-				tName = curNode->tagField;
-			} else if (curNode->parent) {
-				tName = curNode->parent->tagField;
-				curNode = curNode->parent;
+	if (nNodes) {
+		base = _cx_NewNodes (doc, nNodes);
+		cx_lfail (!base, CX_ERR_ALLOC);
+		for (i = 0; i < pd.nChunks; i++) {
+			pd.chunk[i].base += base;
+		}
+		_cx_PoolRun (chunkCopy, &pd, pd.nChunks, nThreads);
+	}
+
+	/*chain top level nodes of chunks one after another*/
+	for (i = 0; i < pd.nChunks; i++) {
+		ch = &pd.chunk[i];
+		if (ch->first) {
+			if (!pd.split->children) {
+				pd.split->children = ch->first + ch->base - 1;
 			} else {
-				return CX_ERR_LONE_TAG;
+				_cx_Node (doc, pd.split->lastChild)->next = \
+					ch->first + ch->base - 1;
 			}
+			pd.split->lastChild = ch->last + ch->base - 1;
+		}
+		chunkArenaMove (&doc->arena, &ch->cookie->arena);
+	}
+	CX_STAT_PHASE (doc, CX_PHASE_DEC_MERGE, t0);
+
+	*_decPtr = bodyEnd;
+
+CX_ERR_LBL:
+	for (i = 0; i < pd.nChunks; i++) {
+#if CX_USING_STATS
+		/*work of chunks is the document's, even if it is done again*/
+		if (pd.chunk[i].cookie) {
+			_cx_StatsMerge (&doc->stats, &pd.chunk[i].cookie->stats);
+			memset (&pd.chunk[i].cookie->stats, 0, sizeof (cx_stats_t));
+			memset (&pd.chunk[i].cookie->flushed, 0, sizeof (cx_stats_t));
+		}
+#endif
+		cx_DestroySession (pd.chunk[i].cookie);
+	}
+	_cx_free (pd.chunk);
 
-			tLen = (size_t)(ptr - decPtr);
-			cx_rfail ((strlen (tName) != tLen) || \
-					(CX_SUCCESS != strncmp (tName, decPtr, tLen)), \
+	return xStatus;
+}
+#endif /*CX_USING_POOL*/
+
+#if CX_USING_LAZY
+#define LAZY_MIN_ENTS 64
+
+/*Double entries of structural index, they are kept till session ends*/
+static cx_status_t lazyGrow (cx_cookie_t *cookie)
+{
+	cx_lazyidx_t *li = &cookie->lazy;
+	uint32_t maxEnts = li->maxEnts ? (li->maxEnts << 1) : LAZY_MIN_ENTS;
+	cx_lazyent_t *ent;
+
+	cx_rfail ((maxEnts <= li->maxEnts), CX_ERR_ALLOC);
+	ent = realloc (li->ent, (size_t)maxEnts * sizeof (cx_lazyent_t));
+	cx_alloc_rfail (ent);
+	CX_STAT_ALLOC (cookie, (size_t)maxEnts * sizeof (cx_lazyent_t));
+	li->ent = ent;
+	li->maxEnts = maxEnts;
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : lazyRun
+ * @brief  : validate xml string upto its end and record its elements in
+ *           structural index of the session; nothing is built
+ * @called : by cx_BuildTreeFromXmlString for CXDEC_LAZY sessions
+ * @input  : cx_lexer_t *lx - lexer state, set up with session and limits
+ *           char **_decPtr - first '<' of the xml string
+ * @output : char **_decPtr - end of string reached
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ *           Tags are taken and checked just like lexRun does, so an xml
+ *           string fails here just as it would when its tree is built
+ */
+static cx_status_t lazyRun (cx_lexer_t *lx, char **_decPtr)
+{
+	cx_status_t xStatus;
+	cx_lazyidx_t *li = &lx->cookie->lazy;
+	cx_lazyent_t *ent;
+	char *decPtr = *_decPtr, *tPtr;
+	cx_lextag_t kind;
+	uint32_t open = 0;
+	size_t tLen;
+	int isSingle;
+
+	li->nEnts = 1;
+	while (1) {
+		SKIP_SPACES (lx, decPtr);
+		if (LEX_EOI (lx, decPtr)) {
+			break;
+		}
+
+		if (*decPtr != '<') {
+			cx_rfail (!open, CX_ERR_INVALID_XML);
+			tPtr = decPtr;
+			decPtr = SCAN_TO (lx, decPtr, CX_SCAN_LT);
+			/*content a built tree would fail on*/
+			cx_rfail (!LEX_LEN_OK (decPtr - tPtr), CX_ERR_DEC_OVERFLOW);
+			continue;
+		}
+
+		decPtr++;
+		cx_func_rfail (lexTag (lx, &decPtr, &kind, &tPtr, &tLen));
+
+		if (kind == LEX_ETAG) {
+			cx_rfail (!open, CX_ERR_LONE_TAG);
+			ent = &li->ent[open];
+			cx_rfail ((ent->nameLen != tLen) || (CX_SUCCESS != \
+						memcmp (lx->start + ent->off + 1, tPtr, tLen)), \
 					CX_ERR_CLOSED_TAG_MISMATCH);
+			ent->end = li->nEnts;
+			ent->close = (uint64_t)(decPtr - lx->start);
+			open = ent->parent;
+		} else if (kind == LEX_STAG) {
+			if (li->nEnts >= li->maxEnts) {
+				cx_func_rfail (lazyGrow (lx->cookie));
+			}
+			ent = &li->ent[li->nEnts++];
+			ent->off = (uint64_t)(tPtr - 1 - lx->start);
+			ent->nameLen = (uint32_t)tLen;
+			ent->parent = open;
+			ent->node = 0;
 
-			decPtr = ptr+1;
-			cx_dec_dbg ("NODE FULL: %s", tName);
-			if (curNode->parent) {
-				curNode = curNode->parent;
+			cx_func_rfail (getNodeAttr (lx, NULL, &decPtr));
+			cx_func_rfail (lexStagEnd (lx, &decPtr, &isSingle));
+			if (isSingle) {
+				ent->end = li->nEnts;
+				ent->close = (uint64_t)(decPtr - lx->start);
+			} else {
+				open = li->nEnts - 1;
 			}
-			prevNode = curNode;
-			goto NEW_TAG;
 		}
-#if CX_USING_INSTR
-		else if (*decPtr == '?') {
-			/*Instruction tag*/
-			decPtr++;
-			type = CXN_INSTR;
+	}
+
+	/*same checks, in the same order, as a built tree is put through*/
+	cx_rfail ((decPtr >= lx->end) && lx->isLimit, CX_ERR_DEC_OVERFLOW);
+	cx_rfail (open, CX_ERR_UNCLOSED_TAG);
+	CX_STAT_ADD (lx->cookie, visited, li->nEnts - 1);
+	*_decPtr = decPtr;
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : lazyBuild
+ * @brief  : build nodes of a part of a lazy session's xml string just as
+ *           lexRun does, but link subtrees built earlier in their place
+ *           instead of building them again
+ * @called : to build subtree of an element, or the whole tree
+ * @input  : cx_lexer_t *lx - lexer state, nodes are linked as it says
+ *           char *decPtr, *end - the part, it starts and ends between tags
+ *           uint32_t e, eEnd - entries of elements within the part
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t lazyBuild (cx_lexer_t *lx, char *decPtr, char *end, \
+		uint32_t e, uint32_t eEnd)
+{
+	cx_status_t xStatus;
+	cx_cookie_t *cookie = lx->cookie;
+	cx_lazyent_t *ent;
+
+	while (e < eEnd) {
+		ent = &cookie->lazy.ent[e];
+		if (!ent->node) {
+			e++;
+			continue;
 		}
-#endif
-#if CX_USING_COMMENTS
-		else if (CX_SUCCESS == strncmp (decPtr, "!--", 3)) {
-			/*Comment tag*/
-			decPtr += 3;
-			SKIP_SPACES(decPtr);
-			type = CXN_COMMENT;
+		lx->end = cookie->xs + ent->off;
+		cx_func_rfail (lexRun (lx, &decPtr));
+		/*built on its own, so it's linked to nothing yet*/
+		populateNodeInTree (lx, _cx_Node (cookie, ent->node));
+		decPtr = cookie->xs + ent->close;
+		e = ent->end;
+	}
+	lx->end = end;
+
+	return lexRun (lx, &decPtr);
+}
+
+/**
+ * Node of element e within subtree of its ancestor a, built already: going
+ * down from a, the child on the way to e is found among element children
+ * by how many siblings come before it in the index
+ */
+static cx_node_t *lazyDescend (cx_cookie_t *cookie, uint32_t a, uint32_t e)
+{
+	cx_lazyent_t *ent = cookie->lazy.ent;
+	cx_node_t *node = _cx_Node (cookie, ent[a].node);
+	uint32_t c = a;
+
+	while (node && (c != e)) {
+		node = _cx_Node (cookie, node->children);
+		for (c++; ; c = ent[c].end) {
+			while (node && !IS_ELEMENT (node)) {
+				node = _cx_Node (cookie, node->next);
+			}
+			if (!node || (ent[c].end > e)) {
+				break;
+			}
+			node = _cx_Node (cookie, node->next);
 		}
-#endif
-#if CX_USING_CDATA
-		else if (CX_SUCCESS == strncmp (decPtr, "![CDATA[", 8)) {
-			/*Cdata tag*/
-			decPtr += 8;
-			type = CXN_CDATA;
+		if (node) {
+			ent[c].node = node->self;
 		}
-#endif
-		else {
-			/*Parent tag.. default*/
-			type = CXN_PARENT;
+	}
+
+	return node;
+}
+
+/*Subtree of element e of a lazy session, built on its own the first time*/
+static cx_node_t *lazyMake (cx_cookie_t *cookie, uint32_t e)
+{
+	cx_lazyent_t *ent = &cookie->lazy.ent[e];
+	uint32_t a;
+	cx_node_t anchor = {0};
+	cx_lexer_t lx = {
+		.cookie = cookie,
+		.start = cookie->xs,
+		/*top level node goes after anchor, so that it's not the root*/
+		.last = &anchor,
+	};
+	cx_status_t xStatus;
+
+	if (!ent->node) {
+		/*inside a subtree built already, it's there, not to be built again*/
+		a = ent->parent;
+		while (a && !cookie->lazy.ent[a].node) {
+			a = cookie->lazy.ent[a].parent;
+		}
+		if (a) {
+			return lazyDescend (cookie, a, e);
 		}
+		xStatus = lazyBuild (&lx, cookie->xs + ent->off, \
+				cookie->xs + ent->close, e + 1, ent->end);
+		cx_trace (DEC_LAZY, 0, xStatus, (uint32_t)ent->off, \
+				(uint32_t)(ent->close - ent->off), e);
+		if ((xStatus != CX_SUCCESS) || lx.open) {
+			return (cx_node_t *)NULL;
+		}
+		ent->node = anchor.next;
+		/*table has subtrees out of document order from now on*/
+		cookie->nodes.unordered = 1;
+	}
 
-		/*a new tag begins*/
-		cx_func_rfail (getNodeFromNewTag (prevNode, &curNode, type, &decPtr));
+	return _cx_Node (cookie, ent->node);
+}
 
-#if CX_USING_INSTR
-		if (!curNode) {
-			/*It's INSTR Node, just don't do anything for this*/
-			cx_dec_dbg ("Skipping INSTR type node for now..");
-			goto TAG_ENDER;
+/**
+ * @func   : _cx_LazyFind
+ * @brief  : find next element with a tag name in structural index of a
+ *           lazy session, and build its subtree if it isn't already
+ * @called : by cx_FindNodeWithTag/cx_FindFirst/cx_FindNext while tree of
+ *           the session isn't built
+ * @input  : cx_cookie_t *cookie - session
+ *           const char *name - tag name
+ *           uint32_t len - length of name
+ *           uint32_t *e - entry to look after, 0 to look from first one
+ * @output : uint32_t *e - entry of the element found, nEnts if none
+ * @return : NULL - if no match found, or its subtree couldn't be built
+ *           !NULL - node of next element with the tag in document order
+ */
+cx_node_t *_cx_LazyFind (cx_cookie_t *cookie, const char *name, uint32_t len, \
+		uint32_t *e)
+{
+	cx_lazyidx_t *li = &cookie->lazy;
+	uint32_t i;
+
+	for (i = *e + 1; i < li->nEnts; i++) {
+		if ((li->ent[i].nameLen == len) && (CX_SUCCESS == \
+					memcmp (cookie->xs + li->ent[i].off + 1, name, len))) {
+			break;
 		}
-#endif
+	}
+	CX_STAT_ADD (cookie, visited, i - *e - 1);
+	*e = i;
 
-		cookie->root = (cookie->root) ? cookie->root : curNode;
-		prevNode = curNode;
+	return (i < li->nEnts) ? lazyMake (cookie, i) : (cx_node_t *)NULL;
+}
 
-		/*Now decPtr points to <space> or '/' or '>'*/
-		cx_dec_dbg ("node: %s", curNode->tagField);
-	} else {
-		if ((size_t)(decPtr - cookie->xs) == strlen (cookie->xs)) {
-			cx_dec_dbg ("DONE!!");
-			return CX_SUCCESS;
+/**
+ * @func   : _cx_LazyBuild
+ * @brief  : build whole tree of a lazy session, subtrees built by lookups
+ *           being linked in as they are, so nodes handed out stay valid
+ * @called : before a tree is walked as a whole or changed, e.g. encoded or
+ *           added to; it does nothing if the tree is already built
+ * @input  : cx_cookie_t *cookie - session
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure, only an allocation
+ *           may fail as the xml string is validated already; the session
+ *           can only be reset/destroyed then
+ */
+cx_status_t _cx_LazyBuild (cx_cookie_t *cookie)
+{
+	cx_lexer_t lx = {
+		.cookie = cookie,
+		.start = cookie->xs,
+	};
+	cx_status_t xStatus;
+
+	if (!CX_LAZY_PENDING (cookie)) {
+		return CX_SUCCESS;
+	}
+	xStatus = lazyBuild (&lx, cookie->xs, cookie->xs + cookie->decLength, \
+			1, cookie->lazy.nEnts);
+	cx_trace (DEC_LAZY, 0, xStatus, 0, (uint32_t)cookie->decLength, 0);
+	_cx_StatsFlush (cookie);
+
+	return xStatus;
+}
+#endif /*CX_USING_LAZY*/
+
+#if CX_USING_FILTER
+/*A tag name of a filter, or a step of its path*/
+typedef struct cx_filtstep_s {
+	const char          *name;
+	uint32_t            len;
+} cx_filtstep_t;
+
+/**
+ * Tag names/paths of a filter
+ * mode - cx_filtmode_t
+ * nPats - number of tag names/paths
+ * anyMask - bit i set if pattern i is a tag name, of any depth
+ * pathMask - bit i set if pattern i is a path, from top level down
+ * pat - nPats patterns, nSteps names of each, from top level down
+ */
+struct cx_filter_s {
+	uint32_t            mode;
+	uint32_t            nPats;
+	uint32_t            anyMask;
+	uint32_t            pathMask;
+	struct {
+		cx_filtstep_t   *step;
+		uint32_t        nSteps;
+	} pat[CX_FILTER_MAX_TAGS];
+};
+
+_Static_assert (CX_FILTER_MAX_TAGS <= 32, \
+		"CX_FILTER_MAX_TAGS must fit in a uint32_t mask");
+
+cx_status_t cx_FilterCreate (cx_filter_t **filter, cx_filtmode_t mode, const char *tags[], uint32_t n)
+{
+	cx_filter_t *flt;
+	cx_filtstep_t *step;
+	const char *s;
+	char *names;
+	size_t nSteps = 0, nChars = 0;
+	uint32_t i;
+
+	cx_null_rfail (filter);
+	cx_null_rfail (tags);
+	cx_rfail (!n || (n > CX_FILTER_MAX_TAGS), CX_ERR_INVALID_TAG);
+	cx_rfail ((mode != CXFLT_KEEP) && (mode != CXFLT_DROP), CX_ERR_INVALID_TAG);
+
+	/*"a/b" is 2 steps, neither can be empty; a leading '/' makes a path*/
+	for (i = 0; i < n; i++) {
+		cx_null_rfail (tags[i]);
+		s = tags[i] + (tags[i][0] == '/');
+		cx_rfail (!*s, CX_ERR_INVALID_TAG);
+		for (nSteps++; *s; s++, nChars++) {
+			if (*s == '/') {
+				cx_rfail (!s[1] || (s[1] == '/'), CX_ERR_INVALID_TAG);
+				nSteps++;
+			}
 		}
-		/*we have a content of parent now.. not a child*/
-		cx_func_rfail (getNodeFromNewTag (prevNode, \
-					&curNode, CXN_CONTENT, &decPtr));
-		cx_dec_dbg ("content: %s", curNode->tagField);
-		/*let prevNode be as it is, this node is just content..
-		 *prevNode reference shall be the parent of this content*/
-		goto NEW_TAG;
 	}
 
-#if CX_USING_INSTR
-TAG_ENDER:
-#endif
-	SKIP_SPACES(decPtr);
-	if (*decPtr == '>') { /*Seems tag name ended*/
-		/*this parent might have children/content/both/end-of-itself*/
-		decPtr++;
-		goto NEW_TAG;
-	} else if (*decPtr == '/') { /*tag ended is self-tag?*/
-		cx_dec_dbg ("self tag: %s", curNode->tagField);
-		goto SELF_TAG;
-	} else if ((curNode->nodeType == CXN_PARENT)) {
-#if CX_USING_TAG_ATTR
-		/*if we have attributes, get them*/
-		cx_func_rfail (getNodeAttr (curNode, &decPtr));
-#endif
+	_cx_calloc (flt, sizeof (cx_filter_t) + (nSteps * sizeof (cx_filtstep_t)) + \
+			nChars);
+	cx_alloc_rfail (flt);
+	step = (cx_filtstep_t *)(flt + 1);
+	names = (char *)(step + nSteps);
+
+	flt->mode = mode;
+	flt->nPats = n;
+	for (i = 0; i < n; i++) {
+		s = tags[i];
+		if ((*s == '/') || strchr (s, '/')) {
+			flt->pathMask |= 1U << i;
+		} else {
+			flt->anyMask |= 1U << i;
+		}
+		s += (*s == '/');
+		flt->pat[i].step = step;
+		for (step->name = names; *s; s++) {
+			if (*s == '/') {
+				step++;
+				step->name = names;
+				flt->pat[i].nSteps++;
+				continue;
+			}
+			*names++ = *s;
+			step->len++;
+		}
+		step++;
+		flt->pat[i].nSteps++;
 	}
+	*filter = flt;
 
-	if (*decPtr == '/') {
-SELF_TAG:
-		/*might be a self-ending-tag*/
-		cx_rfail ((*(decPtr+1) !='>'), CX_ERR_INVALID_TAG);
-		decPtr++;
-		curNode->nodeType = CXN_SINGLE;
-		cx_dec_dbg ("single node: %s", curNode->tagField);
+	return CX_SUCCESS;
+}
+
+void cx_FilterDestroy (cx_filter_t *filter)
+{
+	free (filter);
+}
+
+/**
+ * An element open in a filtered decoding
+ * tag, len - tag name in xml string, attributes follow it
+ * mask - paths of filter that the element's path is a part of
+ * state - FLT_xxx, what's done with the element and what's in it
+ */
+typedef struct cx_fltframe_s {
+	char                *tag;
+	uint32_t            len;
+	uint32_t            mask;
+	uint32_t            state;
+} cx_fltframe_t;
+
+enum {
+	FLT_DROP,  /*not built, nor anything in it*/
+	FLT_PEND,  /*not built yet, it is once an element to keep is in it*/
+	FLT_BUILT, /*built, elements in it are filtered*/
+	FLT_KEEP,  /*built, along with all that's in it*/
+};
+
+/*FLT_xxx of an element in element fr at a depth, mask of its paths too*/
+static uint32_t filterTag (const cx_filter_t *flt, const cx_fltframe_t *fr, \
+		uint32_t depth, const char *tag, size_t len, uint32_t *mask)
+{
+	uint32_t i, s, bit, hit = 0;
+
+	*mask = 0;
+	for (i = 0; i < flt->nPats; i++) {
+		bit = 1U << i;
+		if (!((flt->anyMask | fr->mask) & bit)) {
+			continue;
+		}
+		s = (flt->anyMask & bit) ? 0 : depth;
+		if ((flt->pat[i].step[s].len != len) || \
+				(CX_SUCCESS != memcmp (flt->pat[i].step[s].name, tag, len))) {
+			continue;
+		}
+		if (s == (flt->pat[i].nSteps - 1)) {
+			hit = 1;
+		} else {
+			*mask |= bit;
+		}
+	}
+
+	if (hit) {
+		return (flt->mode == CXFLT_DROP) ? FLT_DROP : FLT_KEEP;
 	}
-	
-	if (*decPtr == '>') {
+	/*if nothing in it can match, don't look into it anymore*/
+	if (flt->mode == CXFLT_DROP) {
+		return (*mask || flt->anyMask) ? FLT_BUILT : FLT_KEEP;
+	}
+	return (*mask || flt->anyMask) ? FLT_PEND : FLT_DROP;
+}
+
+/*Build pending elements upto fr, as an element to keep is found in them*/
+static cx_status_t filterUnpend (cx_lexer_t *lx, cx_fltframe_t *stk, \
+		cx_fltframe_t *fr)
+{
+	cx_status_t xStatus;
+	cx_fltframe_t *p = fr;
+	cx_node_t *node;
+	char *decPtr;
+
+	while ((p > stk) && (p->state == FLT_PEND)) {
+		p--;
+	}
+	for (p++; p <= fr; p++) {
+		cx_func_rfail (getNodeFromNewTag (lx, &node, CXN_PARENT, \
+					p->tag, p->len));
+		decPtr = p->tag + p->len;
+		cx_func_rfail (getNodeAttr (lx, node, &decPtr));
+		lx->open = node;
+		p->state = FLT_BUILT;
+	}
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : filterRun
+ * @brief  : lexRun for a filtered decoding, building only what the filter
+ *           lets through; the rest is scanned just to check it
+ * @called : by cx_BuildTreeFromXmlString when lexer has a filter
+ * @input  : cx_lexer_t *lx - lexer state, with filter
+ *           char **_decPtr - first '<' of the xml string
+ * @output : char **_decPtr - end of string reached
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ *           Tags are taken and checked just like lexRun does, so an xml
+ *           string fails here just as it would when all of it is built
+ */
+static cx_status_t filterRun (cx_lexer_t *lx, char **_decPtr)
+{
+	cx_status_t xStatus;
+	const cx_filter_t *flt = lx->filter;
+	/*stk[0] is the document, its top level elements go in it*/
+	cx_fltframe_t stk[CX_FILTER_MAX_DEPTH + 1], *fr = stk;
+	cx_node_t *curNode = NULL;
+	char *decPtr = *_decPtr, *tPtr;
+	cx_lextag_t kind;
+	size_t tLen;
+	uint32_t state, mask;
+	int keep, isSingle;
+
+	stk[0].state = (flt->mode == CXFLT_DROP) ? FLT_BUILT : FLT_PEND;
+	stk[0].mask = flt->pathMask;
+
+	while (1) {
+		SKIP_SPACES (lx, decPtr);
+		if (LEX_EOI (lx, decPtr)) {
+			break;
+		}
+		/*contents/comments of ancestors of kept elements are dropped*/
+		keep = (fr->state == FLT_KEEP) || \
+			((fr->state == FLT_BUILT) && (flt->mode == CXFLT_DROP));
+
+		if (*decPtr != '<') {
+			cx_rfail ((fr == stk), CX_ERR_INVALID_XML);
+			tPtr = decPtr;
+			decPtr = SCAN_TO (lx, decPtr, CX_SCAN_LT);
+			if (keep) {
+				cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_CONTENT, \
+							tPtr, (size_t)(decPtr - tPtr)));
+			}
+			continue;
+		}
+
 		decPtr++;
+		cx_func_rfail (lexTag (lx, &decPtr, &kind, &tPtr, &tLen));
+
+		switch (kind) {
+		case LEX_ETAG:
+			cx_rfail ((fr == stk), CX_ERR_LONE_TAG);
+			cx_rfail ((fr->len != tLen) || \
+					(CX_SUCCESS != memcmp (fr->tag, tPtr, tLen)), \
+					CX_ERR_CLOSED_TAG_MISMATCH);
+			if (fr->state >= FLT_BUILT) {
+				lx->open->end = lx->cookie->nodes.nNodes;
+				lx->open = _cx_Node (lx->cookie, lx->open->parent);
+			}
+			fr--;
+			break;
+		case LEX_INSTR:
+			break;
+		case LEX_COMMENT:
+		case LEX_CDATA:
+			if (keep) {
+				cx_func_rfail (getNodeFromNewTag (lx, &curNode, \
+							(kind == LEX_CDATA) ? CXN_CDATA : CXN_COMMENT, \
+							tPtr, tLen));
+			}
+			break;
+		case LEX_STAG:
+			/*whatever is in a dropped/kept element goes along with it*/
+			mask = 0;
+			state = ((fr->state == FLT_DROP) || (fr->state == FLT_KEEP)) ? \
+				fr->state : filterTag (flt, fr, (uint32_t)(fr - stk), \
+						tPtr, tLen, &mask);
+			curNode = NULL;
+			if (state >= FLT_BUILT) {
+				if (fr->state == FLT_PEND) {
+					cx_func_rfail (filterUnpend (lx, stk, fr));
+				}
+				cx_func_rfail (getNodeFromNewTag (lx, &curNode, CXN_PARENT, \
+							tPtr, tLen));
+			}
+			cx_func_rfail (getNodeAttr (lx, curNode, &decPtr));
+			cx_func_rfail (lexStagEnd (lx, &decPtr, &isSingle));
+
+			if (isSingle) {
+				if (curNode) {
+					curNode->nodeType = CXN_SINGLE;
+					curNode->end = curNode->self + 1;
+				}
+			} else {
+				cx_rfail ((fr == &stk[CX_FILTER_MAX_DEPTH]), CX_ERR_DEC_OVERFLOW);
+				fr++;
+				fr->tag = tPtr;
+				fr->len = (uint32_t)tLen;
+				fr->mask = mask;
+				fr->state = state;
+				if (curNode) {
+					lx->open = curNode;
+				}
+			}
+			break;
+		}
+	}
+
+	/*same checks, in the same order, as a tree building pass makes*/
+	cx_rfail ((decPtr >= lx->end) && lx->isLimit, CX_ERR_DEC_OVERFLOW);
+	cx_rfail ((fr != stk), CX_ERR_UNCLOSED_TAG);
+	*_decPtr = decPtr;
+
+	return CX_SUCCESS;
+}
+#endif /*CX_USING_FILTER*/
+
+/**
+ * @func   : cx_BuildTreeFromXmlString
+ * @brief  : single forward pass over xml string building the tree, big
+ *           ones of known length are decoded in parallel; for lazy
+ *           sessions, just indexing its elements, and with a filter,
+ *           building just what it lets through
+ * @called : by decoder API once a session is set up for the xml string
+ * @input  : cx_lexer_t *lx - lexer state, set up with session and limits
+ *           char *decPtr - first '<' of the xml string
+ *           uint32_t nThreads - most threads to use, 0 for one per cpu
+ * @output : cookie->decLength - number of bytes consumed from decPtr
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t cx_BuildTreeFromXmlString (cx_lexer_t *lx, char *decPtr, \
+		uint32_t nThreads)
+{
+	cx_status_t xStatus;
+	char *start = decPtr;
+
+#if CX_USING_FILTER
+	if (lx->filter) {
+		cx_func_rfail (filterRun (lx, &decPtr));
+		cx_rfail (!lx->cookie->root, CX_ERR_NODE_NOT_FOUND);
+		lx->cookie->decLength = (uint64_t)(decPtr - start);
+		return CX_SUCCESS;
+	}
+#endif
+#if CX_USING_LAZY
+	if (lx->cookie->decFlags & CXDEC_LAZY) {
+		cx_func_rfail (lazyRun (lx, &decPtr));
+		if (CX_LAZY_PENDING (lx->cookie)) {
+			lx->cookie->decLength = (uint64_t)(decPtr - start);
+			return CX_SUCCESS;
+		}
+		/*no element to index, e.g. just a comment, build it right away*/
+		decPtr = start;
+	}
+#endif
+#if CX_USING_POOL
+	if ((nThreads != 1) && !lx->isLimit && \
+			((lx->end - decPtr) >= CX_PAR_DEC_MIN_SZ) && \
+			(CX_SUCCESS != (xStatus = decParallel (lx, &decPtr, nThreads)))) {
+		/*start over in a single pass, which also finds what's wrong*/
+		cx_trace (DEC_FALLBACK, 0, xStatus, 0, 0, 0);
+		cx_ResetSession (lx->cookie);
+		lx->open = lx->last = NULL;
+		decPtr = start;
 	}
+#else
+	(void)nThreads;
+#endif
+
+	cx_func_rfail (lexRun (lx, &decPtr));
+
+	cx_rfail ((decPtr >= lx->end) && lx->isLimit, CX_ERR_DEC_OVERFLOW);
+	cx_rfail (lx->open, CX_ERR_UNCLOSED_TAG);
+	cx_rfail (!lx->cookie->root, CX_ERR_INVALID_XML);
 
-	goto NEW_TAG;
+	lx->cookie->decLength = (uint64_t)(decPtr - start);
+	cx_dec_dbg ("DONE!! %llu bytes", \
+			(unsigned long long)lx->cookie->decLength);
+
+	return CX_SUCCESS;
 }
 
-cx_status_t cx_DecPkt (void **_cookie, char *str, char *name)
+/*Decode str into a session as per decFlags, lexer being set up with limits*/
+static cx_status_t decString (void **_cookie, char *str, char *name, \
+		uint32_t decFlags, cx_lexer_t *lx, uint32_t nThreads)
 {
 	cx_status_t xStatus = CX_SUCCESS;
 	cx_cookie_t *cookie;
+	char *decPtr;
+	uint64_t t0 = CX_STAT_NOW ();
 
-	cx_null_rfail (str);
-	cx_rfail ((strlen (str) > CX_MAX_DEC_STR_SZ), CX_ERR_DEC_OVERFLOW);
-	cx_rfail (((str = strchr (str, '<')) == NULL), CX_ERR_INVALID_XML);
+	lx->start = str;
+	cx_trace (DEC_BEGIN, 0, 0, 0, (uint32_t)(lx->end - str), nThreads);
+	decPtr = SCAN_TO (lx, str, CX_SCAN_LT);
+	cx_rfail (LEX_EOI (lx, decPtr), \
+			lexEoiErr (lx, decPtr, CX_ERR_INVALID_XML));
 
-	_cx_calloc (cookie, sizeof (*cookie));
-	cx_alloc_rfail (cookie);
+	cookie = (decFlags & CXDEC_REUSE) ? (cx_cookie_t *)*_cookie : NULL;
+	if (cookie) {
+		cx_rfail ((cookie->cxCode != CX_COOKIE_MAGIC), CX_ERR_NULL_PTR);
+		cx_ResetSession (cookie);
+		if (!cookie->xsIsFromUser) { /*buffer of an earlier encode, unused*/
+			_cx_free (cookie->xs);
+			cookie->uxsLength = 0;
+		}
+	} else {
+		cookie = _cx_NewCookie (name);
+		cx_alloc_rfail (cookie);
+	}
 
-	cookie->cxCode = CX_COOKIE_MAGIC;
 	cookie->xs = str;
 	cookie->xsIsFromUser = 1;
-	strncpy (cookie->name, name, CX_COOKIE_NAMELEN);
+	cookie->xsIsDecoded = 1;
+	cookie->decFlags = decFlags;
+	lx->cookie = cookie;
 
-	cx_lfail ((xStatus = cx_BuildTreeFromXmlString (cookie)), xStatus);
+	cx_lfail ((xStatus = cx_BuildTreeFromXmlString (lx, decPtr, nThreads)), \
+			xStatus);
+	cookie->decLength += (uint64_t)(decPtr - str);
+	CX_STAT_ADD (cookie, bytesScanned, cookie->decLength);
 
 	*_cookie = cookie;
 
 CX_ERR_LBL:
+	CX_STAT_ADD (cookie, decodes, 1);
+	CX_STAT_PHASE (cookie, CX_PHASE_DEC, t0);
+	cx_trace (DEC_END, 0, xStatus, 0, \
+			(xStatus == CX_SUCCESS) ? (uint32_t)cookie->decLength : 0, 0);
 	if (xStatus != CX_SUCCESS) {
-		cx_DestroySession (cookie);
+		cx_trace_failed ();
+		if (decFlags & CXDEC_REUSE) {
+			/*session is kept for next packet, just not the broken tree*/
+			cx_ResetSession (cookie);
+			*_cookie = cookie;
+		} else {
+			cx_DestroySession (cookie);
+		}
+	} else {
+		_cx_StatsFlush (cookie);
 	}
 	return xStatus;
 }
+
+cx_status_t _cx_DecPkt (void **_cookie, char *str, char *name, uint32_t decFlags)
+{
+	cx_lexer_t lx = {
+		/*Length is not known upfront, scanning is only allowed to see
+		 *upto CX_MAX_DEC_STR_SZ characters before '\0' shows up*/
+		.end = str + CX_MAX_DEC_STR_SZ + 1,
+		.isLimit = 1,
+	};
+
+	cx_null_rfail (_cookie);
+	cx_null_rfail (str);
+
+	return decString (_cookie, str, name, decFlags, &lx, 1);
+}
+
+#if CX_USING_FILTER
+cx_status_t _cx_DecPktFilter (void **_cookie, char *str, char *name, uint32_t decFlags, const cx_filter_t *filter)
+{
+	cx_lexer_t lx = {
+		.end = str + CX_MAX_DEC_STR_SZ + 1,
+		.isLimit = 1,
+		.filter = filter,
+	};
+
+	cx_null_rfail (_cookie);
+	cx_null_rfail (str);
+	cx_null_rfail (filter);
+
+	/*a filtered tree is built right away, what's dropped isn't indexed*/
+	return decString (_cookie, str, name, decFlags & ~CXDEC_LAZY, &lx, 1);
+}
+#endif
+
+cx_status_t _cx_DecBuf (void **_cookie, char *buf, uint64_t len, char *name, uint32_t decFlags, uint32_t nThreads)
+{
+	cx_lexer_t lx = {
+		/*whole buffer can be scanned, it may not have a '\0' at end*/
+		.end = buf + len,
+	};
+
+	cx_null_rfail (_cookie);
+	cx_null_rfail (buf);
+
+	return decString (_cookie, buf, name, decFlags, &lx, nThreads);
+}
+
+cx_status_t _cx_DecFile (void **_cookie, const char *path, uint32_t decFlags, uint32_t nThreads)
+{
+	cx_status_t xStatus;
+	cx_lexer_t lx = {0};
+	struct stat st;
+	char *map;
+	int fd;
+
+	cx_null_rfail (_cookie);
+	cx_null_rfail (path);
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	cx_rfail ((fd < 0), CX_ERR_FILE);
+	if (fstat (fd, &st) || (st.st_size <= 0) || \
+			((uint64_t)st.st_size > SIZE_MAX)) {
+		close (fd);
+		cx_rfail (1, CX_ERR_FILE);
+	}
+	map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd); /*mapping holds its own reference to the file*/
+	cx_rfail ((map == MAP_FAILED), CX_ERR_FILE);
+	/*pages are scanned once, front to back: read ahead, drop behind*/
+	madvise (map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	lx.end = map + st.st_size;
+	xStatus = decString (_cookie, map, (char *)path, \
+			decFlags | CXDEC_ZEROCOPY, &lx, nThreads);
+	if (xStatus != CX_SUCCESS) {
+		munmap (map, (size_t)st.st_size);
+		return xStatus;
+	}
+	((cx_cookie_t *)*_cookie)->map = map;
+	((cx_cookie_t *)*_cookie)->mapLen = (size_t)st.st_size;
+
+	return CX_SUCCESS;
+}
+
+uint64_t cx_DecLength (void *_cookie)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+
+	return (cookie && (cookie->cxCode == CX_COOKIE_MAGIC)) ? \
+		cookie->decLength : 0;
+}
+
+#if CX_USING_READER
+/*Where a reader is in its xml string*/
+enum {
+	RD_CONTENT, /*between tags/contents*/
+	RD_ATTRS,   /*in a start tag, after its name or an attr*/
+	RD_EOF,     /*at end of a valid xml string*/
+};
+
+static inline void readerEvent (cx_event_t *ev, cx_evtype_t type, \
+		const char *name, size_t nameLen, const char *value, size_t valueLen)
+{
+	ev->type = type;
+	ev->name = name;
+	ev->nameLen = (uint32_t)nameLen;
+	ev->value = value;
+	ev->valueLen = (uint64_t)valueLen;
+}
+
+cx_status_t cx_ReaderOpen (cx_reader_t *rd, const char *buf, uint64_t len)
+{
+	cx_lexer_t lx = {
+		.end = (char *)buf + len,
+	};
+
+	cx_null_rfail (rd);
+	cx_null_rfail (buf);
+
+	rd->end = lx.end;
+	rd->state = RD_CONTENT;
+	rd->depth = 0;
+	rd->seen = 0;
+	/*same as decoder, anything before first '<' is skipped*/
+	rd->cur = SCAN_TO (&lx, (char *)buf, CX_SCAN_LT);
+	rd->xStatus = LEX_EOI (&lx, rd->cur) ? CX_ERR_INVALID_XML : CX_SUCCESS;
+
+	return rd->xStatus;
+}
+
+/**
+ * @func   : readerNext
+ * @brief  : take next item of a reader's xml string, checking it just as
+ *           lexRun does, with the reader's open elements in place of nodes
+ * @called : by cx_ReaderNext on a reader which hasn't failed
+ * @input  : cx_reader_t *rd - reader
+ * @output : cx_event_t *ev - event of the item
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t readerNext (cx_reader_t *rd, cx_event_t *ev)
+{
+	cx_status_t xStatus;
+	cx_lexer_t lx = {
+		.end = (char *)rd->end,
+	};
+	char *decPtr = (char *)rd->cur, *tPtr, *vPtr;
+	cx_lextag_t kind;
+	size_t tLen, vLen;
+	int isSingle;
+
+	if (rd->state == RD_EOF) {
+		readerEvent (ev, CXEV_EOF, NULL, 0, NULL, 0);
+		return CX_SUCCESS;
+	}
+
+	if (rd->state == RD_ATTRS) {
+		SKIP_SPACES (&lx, decPtr);
+		cx_rfail (LEX_EOI (&lx, decPtr), CX_ERR_UNCLOSED_TAG);
+		if ((*decPtr != '>') && (*decPtr != '/')) {
+			cx_func_rfail (lexAttr (&lx, &decPtr, &tPtr, &tLen, &vPtr, &vLen));
+			readerEvent (ev, CXEV_ATTR, tPtr, tLen, vPtr, vLen);
+			rd->cur = decPtr;
+			return CX_SUCCESS;
+		}
+		cx_func_rfail (lexStagEnd (&lx, &decPtr, &isSingle));
+		rd->state = RD_CONTENT;
+		if (isSingle) {
+			rd->depth--;
+			readerEvent (ev, CXEV_END, rd->open[rd->depth].tag, \
+					rd->open[rd->depth].len, NULL, 0);
+			rd->cur = decPtr;
+			return CX_SUCCESS;
+		}
+	}
+
+	while (1) {
+		SKIP_SPACES (&lx, decPtr);
+		if (LEX_EOI (&lx, decPtr)) {
+			/*same checks, in the same order, as a built tree is put through*/
+			cx_rfail (rd->depth, CX_ERR_UNCLOSED_TAG);
+			cx_rfail (!rd->seen, CX_ERR_INVALID_XML);
+			rd->state = RD_EOF;
+			readerEvent (ev, CXEV_EOF, NULL, 0, NULL, 0);
+			break;
+		}
+
+		if (*decPtr != '<') {
+			cx_rfail (!rd->depth, CX_ERR_INVALID_XML);
+			tPtr = decPtr;
+			decPtr = SCAN_TO (&lx, decPtr, CX_SCAN_LT);
+			readerEvent (ev, CXEV_TEXT, NULL, 0, tPtr, \
+					(size_t)(decPtr - tPtr));
+			break;
+		}
+
+		decPtr++;
+		cx_func_rfail (lexTag (&lx, &decPtr, &kind, &tPtr, &tLen));
+
+		if (kind == LEX_INSTR) {
+			/*no event for instructions, decoder discards them too*/
+			continue;
+		}
+		switch (kind) {
+		case LEX_ETAG:
+			cx_rfail (!rd->depth, CX_ERR_LONE_TAG);
+			rd->depth--;
+			cx_rfail ((rd->open[rd->depth].len != tLen) || (CX_SUCCESS != \
+						memcmp (rd->open[rd->depth].tag, tPtr, tLen)), \
+					CX_ERR_CLOSED_TAG_MISMATCH);
+			readerEvent (ev, CXEV_END, tPtr, tLen, NULL, 0);
+			break;
+		case LEX_COMMENT:
+		case LEX_CDATA:
+			rd->seen = 1;
+			readerEvent (ev, (kind == LEX_CDATA) ? CXEV_CDATA : CXEV_COMMENT, \
+					NULL, 0, tPtr, tLen);
+			break;
+		default:
+			cx_rfail ((rd->depth == CX_READER_MAX_DEPTH), CX_ERR_DEC_OVERFLOW);
+			rd->open[rd->depth].tag = tPtr;
+			rd->open[rd->depth].len = (uint32_t)tLen;
+			rd->depth++;
+			rd->seen = 1;
+			rd->state = RD_ATTRS;
+			readerEvent (ev, CXEV_START, tPtr, tLen, NULL, 0);
+			break;
+		}
+		break;
+	}
+	rd->cur = decPtr;
+
+	return CX_SUCCESS;
+}
+
+cx_status_t cx_ReaderNext (cx_reader_t *rd, cx_event_t *ev)
+{
+	cx_null_rfail (rd);
+	cx_null_rfail (ev);
+
+	if (rd->xStatus == CX_SUCCESS) {
+		rd->xStatus = readerNext (rd, ev);
+	}
+
+	return rd->xStatus;
+}
+
+/*Is next event of a reader an attr of the element it just started?*/
+int _cx_ReaderInTag (const cx_reader_t *rd)
+{
+	const char *ptr = rd->cur;
+
+	if (rd->state != RD_ATTRS) {
+		return 0;
+	}
+	while ((ptr < rd->end) && IS_SPACE (*ptr)) {
+		ptr++;
+	}
+	/*broken tag is left to next cx_ReaderNext to fail on*/
+	return (ptr >= rd->end) || ((*ptr != '>') && (*ptr != '/'));
+}
+#endif /*CX_USING_READER*/
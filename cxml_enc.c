@@ -15,320 +15,805 @@
 #define IS_ROOTNODE_SINGLE(node) \
 	((node->nodeType != CXN_SINGLE) || !(node->children))
 
+#define IS_ELEMENT_TYPE(type) (((type) == CXN_PARENT) || ((type) == CXN_SINGLE))
+
+/*give CX_SUCCESS if addtype is valid*/
+#define BAD_ADDTYPE_VAL(type) \
+	((type <= CXADD_MINTYPE) || (type >= CXADD_MAXTYPE))
+
+/* Serialized forms of nodes, locked in correspondence with cxn_type_t,
+ * [0] is what goes before tagField and [1] what goes after it; PARENT
+ * node's start tag is closed after its attrs, and it has an end tag too */
+static const char *cxeFmt[2][CXN_MAX] = {
+	[0] = {
+		[CXN_PARENT]    = "<",
+		[CXN_SINGLE]    = "<",
+		[CXN_COMMENT]   = "<!--",
+		[CXN_INSTR]     = "<?",
+		[CXN_CDATA]     = "<![CDATA[",
+		[CXN_CONTENT]   = "",
+	},
+	[1] = {
+		[CXN_PARENT]    = ">",
+		[CXN_SINGLE]    = "/>",
+		[CXN_COMMENT]   = "-->",
+		[CXN_INSTR]     = "?>",
+		[CXN_CDATA]     = "]]>",
+		[CXN_CONTENT]   = "",
+	},
+};
+
+/*strlen of above strings, end tag "</>" of PARENT node included in [1]*/
+static const uint8_t cxeFmtLen[2][CXN_MAX] = {
+	[0] = {
+		[CXN_PARENT] = 1, [CXN_SINGLE] = 1, [CXN_COMMENT] = 4,
+		[CXN_INSTR] = 2, [CXN_CDATA] = 9, [CXN_CONTENT] = 0,
+	},
+	[1] = {
+		[CXN_PARENT] = 1 + 3, [CXN_SINGLE] = 2, [CXN_COMMENT] = 3,
+		[CXN_INSTR] = 2, [CXN_CDATA] = 3, [CXN_CONTENT] = 0,
+	},
+};
+
+/*Bytes a node adds to xml string, leaving out its attrs and children*/
+#define NODE_ENC_LEN(type, tagLen) \
+	(cxeFmtLen[0][type] + cxeFmtLen[1][type] + \
+	 ((type) == CXN_PARENT ? 2 : 1) * (tagLen))
+
+/*Bytes an attr adds to xml string: ' name="value"'*/
+#define ATTR_ENC_LEN(nameLen, valueLen) ((nameLen) + (valueLen) + 4)
+
+/*"<?" XML_INSTR_STR "?>" heads every encoded xml string*/
+#define XML_VERSTRING_LEN (sizeof (XML_INSTR_STR) - 1 + 4)
+
+/**
+ * Output position of encoder, every write is checked against end
+ * ptr - where next byte goes
+ * end - end of buffer, one byte is always left for '\0' before it
+ */
+typedef struct cx_encbuf_s {
+	char                *ptr;
+	char                *end;
+} cx_encbuf_t;
+
+static inline cx_status_t encPut (cx_encbuf_t *eb, const char *src, size_t len)
+{
+	cx_rfail (((size_t)(eb->end - eb->ptr) < len), CX_ERR_ENC_OVERFLOW);
+	memcpy (eb->ptr, src, len);
+	eb->ptr += len;
+
+	return CX_SUCCESS;
+}
+
 #if CX_USING_TAG_ATTR
 
 #define IS_HAVING_ATTR(node) (node->numOfAttr && node->attrList)
 
-static void _cx_PutNodeAttr (cx_node_t *xmlNode, char **encPtr)
-{ /*Remove numOfAttr and add last pointer -TODO*/
+static cx_status_t _cx_PutNodeAttr (cx_node_t *xmlNode, cx_encbuf_t *eb)
+{
+	cx_status_t xStatus;
 	uint8_t n = xmlNode->numOfAttr;
 	cxn_attr_t *attrListPtr = xmlNode->attrList;
 
 	for (; n && attrListPtr; n--, attrListPtr = attrListPtr->next) {
-		*encPtr += sprintf (*encPtr, " %s=\"%s\"", \
-				attrListPtr->attrName, attrListPtr->attrValue);
-		cx_enc_dbg ("attr::\n\r%s\n\r", *encPtr);
+		cx_func_rfail (encPut (eb, " ", 1));
+		cx_func_rfail (encPut (eb, attrListPtr->attrName, \
+					attrListPtr->nameLen));
+		cx_func_rfail (encPut (eb, "=\"", 2));
+		cx_func_rfail (encPut (eb, attrListPtr->attrValue, \
+					attrListPtr->valueLen));
+		cx_func_rfail (encPut (eb, "\"", 1));
+		cx_enc_dbg ("attr: %.*s", attrListPtr->nameLen, attrListPtr->attrName);
 	}
+
+	return CX_SUCCESS;
 }
 
 #endif
 
-static void _xml_verstring (char **encPtr)
-{
-	*encPtr += sprintf (*encPtr, "<?%s?>", XML_INSTR_STR);
-}
-
-static cx_status_t cx_BuildXmlString (cx_cookie_t *cookie)
+/*Start tag of an element with its attrs, or whole of any other node*/
+static inline cx_status_t encStartTag (cx_node_t *node, cx_encbuf_t *eb)
 {
-	/* _cxe_fmt Locked in correspondence with cxn_type_t,
-	 * _cxe_fmt[0] contains beginning of node data
-	 * _cxe_fmt[1] contains the end! */
-	const char *_cxe_fmt[2][CXN_MAX] = {
-		[0] = {
-			[CXN_PARENT]    = "<%s",
-			[CXN_SINGLE]    = "<%s",
-			[CXN_COMMENT]   = "<!--%s",
-			[CXN_INSTR]     = "<?%s?>",
-			[CXN_CDATA]     = "<![CDATA[",
-			[CXN_CONTENT]   = "%s",
-		},
-		[1] = {
-			[CXN_PARENT]    = ">",
-			[CXN_SINGLE]    = "/>",
-			[CXN_COMMENT]   = "-->",
-			[CXN_INSTR]     = "?>",
-			[CXN_CDATA]     = "]]>",
-			[CXN_CONTENT]   = "",
-		},
-	};
-	cx_node_t *curNode = cookie->root;
-	char *encPtr = cookie->xs;
-
-	_xml_verstring (&encPtr);
+	cx_status_t xStatus;
+	uint8_t type = node->nodeType;
 
-	while (1) {
-		encPtr += sprintf (encPtr, \
-				_cxe_fmt[0][curNode->nodeType], curNode->tagField);
+	cx_func_rfail (encPut (eb, cxeFmt[0][type], cxeFmtLen[0][type]));
+	cx_func_rfail (encPut (eb, node->tagField, node->tagLen));
 
 #if CX_USING_TAG_ATTR
-		if (IS_HAVING_ATTR (curNode)) {
-			_cx_PutNodeAttr (curNode, &encPtr);
-		}
+	if (IS_HAVING_ATTR (node)) {
+		cx_func_rfail (_cx_PutNodeAttr (node, eb));
+	}
 #endif
 
-		strcat (encPtr, _cxe_fmt[1][curNode->nodeType]);
-		encPtr += strlen (_cxe_fmt[1][curNode->nodeType]);
+	return encPut (eb, cxeFmt[1][type], strlen (cxeFmt[1][type]));
+}
 
-		cx_enc_dbg ("++\n\r%s\n\r..", cookie->xs);
+static inline cx_status_t encEndTag (cx_node_t *node, cx_encbuf_t *eb)
+{
+	cx_status_t xStatus;
 
-		cx_rfail (((encPtr - cookie->xs) > CX_MAX_ENC_STR_SZ), \
-				CX_ERR_ENC_OVERFLOW);
+	cx_func_rfail (encPut (eb, "</", 2));
+	cx_func_rfail (encPut (eb, node->tagField, node->tagLen));
+
+	return encPut (eb, ">", 1);
+}
+
+/* Walks a subtree by its links; while node table is in document order, the
+ * first child is the very next node and next sibling is the node after the
+ * subtree, so the table is just read front to back */
+static cx_status_t encSubtree (cx_cookie_t *cookie, cx_node_t *top, \
+		cx_encbuf_t *eb)
+{
+	cx_status_t xStatus;
+	cx_node_t *curNode = top;
+
+	while (1) {
+		cx_func_rfail (encStartTag (curNode, eb));
 
 		if (curNode->children) {
-			curNode = curNode->children;
+			curNode = _cx_Node (cookie, curNode->children);
 			continue;
 		}
 
 NEXT_NODE:
 		if (curNode->nodeType == CXN_PARENT) {
-			encPtr += sprintf (encPtr, "</%s>", curNode->tagField);
-			cx_enc_dbg ("+++\n\r%s\n\r...", cookie->xs);
-			cx_rfail (((encPtr - cookie->xs) > CX_MAX_ENC_STR_SZ), \
-					CX_ERR_ENC_OVERFLOW);
+			cx_func_rfail (encEndTag (curNode, eb));
 		}
-		if (curNode->next) {
-			curNode = curNode->next;
-		} else if (curNode->parent) {
-			curNode = curNode->parent;
-			cx_enc_dbg ("back to: %s\n\r", curNode->tagField);
-			goto NEXT_NODE;
-		} else {
+		if (curNode == top) {
 			break;
+		} else if (curNode->next) {
+			curNode = _cx_Node (cookie, curNode->next);
+		} else {
+			curNode = _cx_Node (cookie, curNode->parent);
+			cx_enc_dbg ("back to: %.*s", curNode->tagLen, curNode->tagField);
+			goto NEXT_NODE;
 		}
 	}
 
 	return CX_SUCCESS;
 }
 
-cx_status_t cx_EncPkt (void *_cookie, char **xmlData)
+static cx_status_t cx_BuildXmlString (cx_cookie_t *cookie, cx_encbuf_t *eb)
 {
-    cx_status_t xStatus;
-	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	cx_status_t xStatus;
+	cx_node_t *curNode;
+
+	cx_func_rfail (encPut (eb, "<?" XML_INSTR_STR "?>", XML_VERSTRING_LEN));
+
+	for (curNode = cookie->root; curNode; \
+			curNode = _cx_Node (cookie, curNode->next)) {
+		cx_func_rfail (encSubtree (cookie, curNode, eb));
+	}
+	*eb->ptr = '\0';
+
+	return CX_SUCCESS;
+}
+
+/*Bytes a node adds to xml string along with its attrs*/
+static inline size_t nodeEncLen (cx_node_t *node)
+{
+	size_t len = NODE_ENC_LEN (node->nodeType, node->tagLen);
+#if CX_USING_TAG_ATTR
+	cxn_attr_t *attr = node->attrList;
+	uint8_t n;
+
+	for (n = node->numOfAttr; n && attr; n--, attr = attr->next) {
+		len += ATTR_ENC_LEN (attr->nameLen, attr->valueLen);
+	}
+#endif
+	return len;
+}
+
+/*Bytes a subtree adds to xml string, as encSubtree would put them*/
+static size_t subtreeEncLen (cx_cookie_t *cookie, cx_node_t *top)
+{
+	cx_node_t *curNode = top;
+	size_t len = 0;
+	uint32_t i, end;
+
+	if (!cookie->nodes.unordered) {
+		/*subtree is a range of the table*/
+		end = CX_NODE_END (cookie, top);
+		for (i = top->self; i < end; i++) {
+			len += nodeEncLen (_cx_Node (cookie, i));
+		}
+		return len;
+	}
 
-	cx_null_rfail (cookie->root);
-	cx_rfail (IS_INVALID_NODE_TYPE(cookie->root->nodeType), \
+	while (1) {
+		len += nodeEncLen (curNode);
+		if (curNode->children) {
+			curNode = _cx_Node (cookie, curNode->children);
+			continue;
+		}
+		while ((curNode != top) && !curNode->next) {
+			curNode = _cx_Node (cookie, curNode->parent);
+		}
+		if (curNode == top) {
+			return len;
+		}
+		curNode = _cx_Node (cookie, curNode->next);
+	}
+}
+
+/*Exact length of xml string of a decoded tree, which isn't kept as the
+ *tree is built; nodes/attrs added to it since included*/
+static uint64_t treeEncLen (cx_cookie_t *cookie)
+{
+	uint64_t len = XML_VERSTRING_LEN;
+	cx_node_t *curNode;
+
+	for (curNode = cookie->root; curNode; \
+			curNode = _cx_Node (cookie, curNode->next)) {
+		len += subtreeEncLen (cookie, curNode);
+	}
+
+	return len;
+}
+
+#if CX_USING_POOL
+/**
+ * Consecutive children of root, encoded by one worker
+ * first - first child of the group
+ * count - number of children in the group
+ * off - where in xml string the group starts
+ * len - bytes the group adds to xml string
+ * xStatus - status of encoding the group
+ */
+typedef struct cx_encgroup_s {
+	cx_node_t           *first;
+	uint32_t            count;
+	size_t              off;
+	size_t              len;
+	cx_status_t         xStatus;
+} cx_encgroup_t;
+
+/*A tree being encoded in parallel, in nGroups groups*/
+typedef struct cx_parenc_s {
+	cx_cookie_t         *cookie;
+	cx_encgroup_t       *group;
+	uint32_t            nGroups;
+} cx_parenc_t;
+
+static void groupEncLen (void *arg, uint32_t i)
+{
+	cx_parenc_t *pe = (cx_parenc_t *)arg;
+	cx_encgroup_t *g = &pe->group[i];
+	cx_node_t *node = g->first;
+	uint32_t n;
+
+	for (n = 0, g->len = 0; n < g->count; n++) {
+		g->len += subtreeEncLen (pe->cookie, node);
+		node = _cx_Node (pe->cookie, node->next);
+	}
+}
+
+static void groupEncode (void *arg, uint32_t i)
+{
+	cx_parenc_t *pe = (cx_parenc_t *)arg;
+	cx_encgroup_t *g = &pe->group[i];
+	cx_encbuf_t eb = {
+		.ptr = pe->cookie->xs + g->off,
+		.end = pe->cookie->xs + g->off + g->len,
+	};
+	cx_node_t *node = g->first;
+	uint32_t n;
+
+	g->xStatus = CX_SUCCESS;
+	for (n = 0; (n < g->count) && (g->xStatus == CX_SUCCESS); n++) {
+		g->xStatus = encSubtree (pe->cookie, node, &eb);
+		node = _cx_Node (pe->cookie, node->next);
+	}
+}
+
+/**
+ * @func   : encParallel
+ * @brief  : build xml string with children of root split into groups,
+ *           whose sizes are summed up on the worker pool first, so that
+ *           their offsets are known and each is put right in its place
+ *           by a worker
+ * @called : by encString for big trees
+ * @input  : cx_cookie_t *cookie - session being encoded
+ *           cx_encbuf_t *eb - buffer of xmlLength bytes and '\0'
+ *           uint32_t nThreads - most threads to use, 0 for one per cpu
+ * @output : cx_encbuf_t *eb - the whole xml string
+ * @return : CX_SUCCESS on success
+ *           non-zero value if tree can't be split or isn't xmlLength
+ *           bytes; xml string may be partly written then
+ *           xml string is byte by byte the same as cx_BuildXmlString's
+ */
+static cx_status_t encParallel (cx_cookie_t *cookie, cx_encbuf_t *eb, \
+		uint32_t nThreads)
+{
+	cx_status_t xStatus = CX_SUCCESS;
+	cx_node_t *root = cookie->root, *curNode;
+	cx_parenc_t pe = { .cookie = cookie };
+	uint32_t nKids, i, g;
+	size_t off;
+	uint64_t t0;
+
+	cx_rfail ((root->nodeType != CXN_PARENT) || !root->children, \
+			CX_ERR_INVALID_ROOT);
+	for (nKids = 0, curNode = _cx_Node (cookie, root->children); curNode; \
+			curNode = _cx_Node (cookie, curNode->next)) {
+		nKids++;
+	}
+	pe.nGroups = _cx_PoolThreads (nThreads) * CX_PAR_ENC_CHUNKS;
+	if (pe.nGroups > nKids) {
+		pe.nGroups = nKids;
+	}
+	cx_rfail ((pe.nGroups < 2), CX_ERR_INVALID_ROOT);
+	_cx_calloc (pe.group, pe.nGroups * sizeof (cx_encgroup_t));
+	cx_alloc_rfail (pe.group);
+	CX_STAT_ALLOC (cookie, pe.nGroups * sizeof (cx_encgroup_t));
+
+	/*even number of children per group, stealing evens out the rest*/
+	for (i = 0, g = 0, curNode = _cx_Node (cookie, root->children); \
+			curNode; i++, curNode = _cx_Node (cookie, curNode->next)) {
+		if (i == (uint32_t)(((uint64_t)nKids * (g + 1)) / pe.nGroups)) {
+			g++;
+		}
+		if (!pe.group[g].first) {
+			pe.group[g].first = curNode;
+		}
+		pe.group[g].count++;
+	}
+	t0 = CX_STAT_NOW ();
+	_cx_PoolRun (groupEncLen, &pe, pe.nGroups, nThreads);
+	CX_STAT_PHASE (cookie, CX_PHASE_ENC_SIZE, t0);
+
+	/*offsets are prefix sums of the sizes, after start tag of root*/
+	cx_func_lfail (encPut (eb, "<?" XML_INSTR_STR "?>", XML_VERSTRING_LEN));
+	cx_func_lfail (encStartTag (root, eb));
+	for (g = 0, off = (size_t)(eb->ptr - cookie->xs); g < pe.nGroups; g++) {
+		pe.group[g].off = off;
+		off += pe.group[g].len;
+	}
+	for (curNode = _cx_Node (cookie, root->next); curNode; \
+			curNode = _cx_Node (cookie, curNode->next)) {
+		off += subtreeEncLen (cookie, curNode);
+	}
+	cx_lfail (((off + 3 + root->tagLen) != cookie->xmlLength), \
+			CX_ERR_ENC_OVERFLOW);
+
+	_cx_PoolRun (groupEncode, &pe, pe.nGroups, nThreads);
+	for (g = 0; g < pe.nGroups; g++) {
+		cx_func_lfail (pe.group[g].xStatus);
+	}
+
+	eb->ptr = cookie->xs + pe.group[pe.nGroups - 1].off + \
+			  pe.group[pe.nGroups - 1].len;
+	cx_func_lfail (encEndTag (root, eb));
+	for (curNode = _cx_Node (cookie, root->next); curNode; \
+			curNode = _cx_Node (cookie, curNode->next)) {
+		cx_func_lfail (encSubtree (cookie, curNode, eb));
+	}
+	*eb->ptr = '\0';
+
+CX_ERR_LBL:
+	_cx_free (pe.group);
+
+	return xStatus;
+}
+#endif /*CX_USING_POOL*/
+
+/*Encode tree of a session of upto maxLen bytes, into its own/user buffer*/
+static cx_status_t encString (cx_cookie_t *cookie, char **xmlData, \
+		uint64_t maxLen, uint32_t nThreads)
+{
+	cx_status_t xStatus;
+	cx_encbuf_t eb;
+	uint64_t t0 = CX_STAT_NOW ();
+
+	cx_null_rfail (cookie);
+	cx_trace (ENC_BEGIN, 0, 0, 0, (uint32_t)cookie->xmlLength, nThreads);
+	cx_func_lfail (_cx_LazyBuild (cookie));
+	cx_null_lfail (cookie->root);
+	cx_lfail (IS_INVALID_NODE_TYPE(cookie->root->nodeType), \
 			CX_ERR_INVALID_ROOT);
-	cx_rfail (!IS_ROOTNODE_SINGLE (cookie->root), CX_ERR_LONE_ROOT);
+	cx_lfail (!IS_ROOTNODE_SINGLE (cookie->root), CX_ERR_LONE_ROOT);
+	if (cookie->decLength) {
+		cookie->xmlLength = treeEncLen (cookie);
+	}
+	cx_lfail ((cookie->xmlLength > maxLen), CX_ERR_ENC_OVERFLOW);
+	if (cookie->xsIsDecoded) {
+		/*xs is the input, tree may point into it; encode into our own*/
+		cookie->xs = NULL;
+		cookie->xsIsFromUser = cookie->xsIsDecoded = 0;
+		cookie->uxsLength = 0;
+	}
 
 	if (!cookie->xsIsFromUser) { /*if we have to manage xml-string memory*/
-		/*get actual xml-strlen including tag-delimiters! -TODO*/
-		_cx_calloc (cookie->xs, cookie->xmlLength);
-		cx_alloc_rfail (cookie->xs);
+		/*exact length is known, allocate once for it and '\0' unless the
+		 *buffer of an earlier packet already fits it*/
+		if (cookie->uxsLength <= cookie->xmlLength) {
+			_cx_free (cookie->xs);
+			cookie->uxsLength = 0;
+			_cx_malloc (cookie->xs, cookie->xmlLength + 1);
+			cx_alloc_lfail (cookie->xs);
+			CX_STAT_ALLOC (cookie, cookie->xmlLength + 1);
+			cookie->uxsLength = cookie->xmlLength + 1;
+		}
+		eb.end = cookie->xs + cookie->xmlLength;
+	} else {
+		cx_lfail ((cookie->xmlLength >= cookie->uxsLength), \
+				CX_ERR_ENC_OVERFLOW);
+		eb.end = cookie->xs + cookie->uxsLength - 1;
 	}
+	eb.ptr = cookie->xs;
 
-	xStatus = cx_BuildXmlString (cookie);
-	cx_rfail ((xStatus != CX_SUCCESS), xStatus);
+#if CX_USING_POOL
+	if ((nThreads != 1) && (cookie->xmlLength >= CX_PAR_ENC_MIN_SZ) && \
+			(CX_SUCCESS == encParallel (cookie, &eb, nThreads))) {
+		xStatus = CX_SUCCESS;
+	} else {
+		/*too small to split, or tree is odd; a single pass tells*/
+		eb.ptr = cookie->xs;
+		xStatus = cx_BuildXmlString (cookie, &eb);
+	}
+#else
+	(void)nThreads;
+	xStatus = cx_BuildXmlString (cookie, &eb);
+#endif
+	cx_lfail ((xStatus != CX_SUCCESS), xStatus);
 
 	if (!cookie->xsIsFromUser) {
-		cx_null_rfail (xmlData);
+		cx_null_lfail (xmlData);
 		*xmlData = cookie->xs;
 	}
+	CX_STAT_ADD (cookie, bytesEncoded, cookie->xmlLength);
 
 	cx_enc_dbg ("PACKET: \n%s\n", cookie->xs);
 
+CX_ERR_LBL:
+	CX_STAT_ADD (cookie, encodes, 1);
+	CX_STAT_PHASE (cookie, CX_PHASE_ENC, t0);
+	_cx_StatsFlush (cookie);
+	cx_trace (ENC_END, 0, xStatus, 0, \
+			(xStatus == CX_SUCCESS) ? (uint32_t)cookie->xmlLength : 0, 0);
+	if (xStatus != CX_SUCCESS) {
+		cx_trace_failed ();
+	}
+
 	return xStatus;
 }
 
+cx_status_t cx_EncPkt (void *_cookie, char **xmlData)
+{
+	return encString ((cx_cookie_t *)_cookie, xmlData, CX_MAX_ENC_STR_SZ, 1);
+}
+
+cx_status_t cx_EncBuf (void *_cookie, char **xmlData, uint32_t nThreads)
+{
+	return encString ((cx_cookie_t *)_cookie, xmlData, UINT64_MAX, nThreads);
+}
+
+uint64_t cx_EncLength (void *_cookie)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+
+	if (!cookie || (cookie->cxCode != CX_COOKIE_MAGIC)) {
+		return 0;
+	}
+	if (cookie->decLength) {
+		if ((CX_SUCCESS != _cx_LazyBuild (cookie)) || !cookie->root) {
+			return 0;
+		}
+		cookie->xmlLength = treeEncLen (cookie);
+	}
+
+	return cookie->xmlLength;
+}
+
 #if CX_USING_TAG_ATTR
-cx_status_t _cx_AddAttrToNode (void *_cookie, char *attrName, cxa_value_u *value, cxattr_type_t type, char *nodeName)
+/**
+ * @func   : _cx_BuildAttr
+ * @brief  : adds an attribute at the end of attr list of a node
+ * @called : by cx_BuildAttr_xxx with the node handle user has, and by
+ *           cx_AddAttr_xxx once the node is found by its tag
+ * @input  : void *_cookie - pointer to select xml-context
+ *           cx_node_t *node - PARENT/SINGLE node of this session
+ *           char *attrName - name of attr
+ *           cxa_value_u *value - value of attr, string itself for CXATTR_STR
+ *           cxattr_type_t type - type of value
+ * @output : none
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+cx_status_t _cx_BuildAttr (void *_cookie, cx_node_t *node, char *attrName, cxa_value_u *value, cxattr_type_t type)
 {
-	cx_status_t xStatus;
 	_cx_def_fmts_array (fmt_spec);
 	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
-	cx_node_t *node;
 	cxn_attr_t *newAttr;
+	const char *symName = NULL;
+	cx_status_t xStatus;
 
-	cx_rfail (!nodeName, CX_ERR_NULL_NODENAME);
+	cx_null_rfail (cookie);
+	cx_func_rfail (_cx_LazyBuild (cookie));
+	cx_rfail (!node, CX_ERR_NODE_NOT_FOUND);
+	cx_rfail (!IS_ELEMENT_TYPE (node->nodeType), CX_ERR_INVALID_NODE);
 	cx_rfail (!attrName, CX_ERR_NULL_ATTRNAME);
 	cx_rfail (!value, CX_ERR_NULL_ATTRVALUE);
 	cx_rfail (IS_INVALID_ATTR_TYPE (type), CX_ERR_INVALID_ATTR);
+	/*encoder walks numOfAttr attrs, it can't count beyond this*/
+	cx_rfail ((node->numOfAttr == UINT8_MAX), CX_ERR_INVALID_ATTR);
 
-	/* Try to update this to force user to follow xml string update in order.
-	 * adding child to nodeX, then adding attr to nodeX is time-wasting -TODO*/
-	node = cx_FindNodeWithTag (cookie, nodeName);
-	cx_rfail (!node, CX_ERR_NODE_NOT_FOUND);
-
-	_cx_malloc (newAttr, sizeof (cxn_attr_t));
+	_cx_acalloc (&cookie->arena, newAttr, sizeof (cxn_attr_t));
 	cx_alloc_rfail (newAttr);
 
-	newAttr->attrName = _cx_strndup (attrName, strlen (attrName), attrName);
-	cx_lfail (!newAttr->attrName, CX_ERR_ALLOC);
+	newAttr->nameLen = strlen (attrName);
+	newAttr->nameId = _cx_SymIntern (attrName, newAttr->nameLen, &symName);
+	newAttr->attrName = newAttr->nameId ? (char *)symName : \
+		_cx_strndup (&cookie->arena, attrName, newAttr->nameLen);
+	cx_alloc_rfail (newAttr->attrName);
 	cx_enc_dbg ("attr: %s=", newAttr->attrName);
-	{
-		/* If value's a user-string, allocate memory to suit it's length
-		 * If not a string type, get the size using the type*/
-		_cx_def_size_array (size_spec);
-		size_t _sz = (type == CXATTR_STR) ? \
-					 strlen ((char *)value) : size_spec[type];
-		_cx_calloc (newAttr->attrValue, 2/*2 " symbols*/ + _sz);
-		cx_alloc_lfail (newAttr->attrValue);
-	}
-	newAttr->next = NULL;
-
-	switch (type) {
-		case CXATTR_STR:
-			sprintf (newAttr->attrValue, fmt_spec[type], (char *)value);
-			break;
-		case CXATTR_CHAR:
-			sprintf (newAttr->attrValue, fmt_spec[type], (char)value->xVal);
-			break;
-		case CXATTR_UI8:
-			sprintf (newAttr->attrValue, fmt_spec[type], (uint8_t)value->xVal);
-			break;
-		case CXATTR_SI8:
-			sprintf (newAttr->attrValue, fmt_spec[type], (int8_t)value->xVal);
-			break;
-		case CXATTR_UI16:
-			sprintf (newAttr->attrValue, fmt_spec[type], (uint16_t)value->xVal);
-			break;
-		case CXATTR_SI16:
-			sprintf (newAttr->attrValue, fmt_spec[type], (int16_t)value->xVal);
-			break;
-		case CXATTR_UI32:
-			sprintf (newAttr->attrValue, fmt_spec[type], (uint32_t)value->xVal);
-			break;
-		case CXATTR_SI32:
-			sprintf (newAttr->attrValue, fmt_spec[type], (int32_t)value->xVal);
-			break;
-		case CXATTR_FLOAT:
-			sprintf (newAttr->attrValue, fmt_spec[type], (float)value->xVal);
-			break;
-		case CXATTR_MAX: /*Just removing compiler warning*/
-			break;
+
+	if (type == CXATTR_STR) {
+		newAttr->valueLen = strlen ((char *)value);
+		newAttr->attrValue = _cx_strndup (&cookie->arena, (char *)value, \
+				newAttr->valueLen);
+	} else {
+		/*enough for any of the numeric/char types, incl. a float*/
+		char valStr[64];
+		int len = 0;
+
+		switch (type) {
+			case CXATTR_CHAR:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->ch);
+				break;
+			case CXATTR_UI8:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_u8);
+				break;
+			case CXATTR_SI8:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_i8);
+				break;
+			case CXATTR_UI16:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_u16);
+				break;
+			case CXATTR_SI16:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_i16);
+				break;
+			case CXATTR_UI32:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_u32);
+				break;
+			case CXATTR_SI32:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->n_i32);
+				break;
+			case CXATTR_FLOAT:
+				len = snprintf (valStr, sizeof (valStr), fmt_spec[type], value->f);
+				break;
+			default: /*Just removing compiler warning*/
+				break;
+		}
+		cx_rfail (((len <= 0) || (len >= (int)sizeof (valStr))), \
+				CX_ERR_INVALID_ATTR);
+		newAttr->valueLen = (uint32_t)len;
+		newAttr->attrValue = _cx_strndup (&cookie->arena, valStr, len);
+	}
+	cx_rfail (newAttr->valueLen && !newAttr->attrValue, CX_ERR_ALLOC);
+	if (!newAttr->attrValue) {
+		newAttr->attrValue = "";
 	}
 	cx_enc_dbg ("attr-val-str: %s\n", newAttr->attrValue);
 
 	if (!node->attrList) {
-		cx_enc_dbg ("1st attr\n");
 		node->attrList = newAttr;
-		node->numOfAttr = 0;
 	} else {
-		cxn_attr_t *link = node->attrList;
-		cx_enc_dbg ("linking attr\n");
-		for (; link->next; link = link->next);
-		link->next = newAttr;
+		node->lastAttr->next = newAttr;
 	}
-
+	node->lastAttr = newAttr;
 	node->numOfAttr++;
+	CX_STAT_ADD (cookie, attrs, 1);
+	cookie->xmlLength += ATTR_ENC_LEN (newAttr->nameLen, newAttr->valueLen);
 
 	return CX_SUCCESS;
+}
 
-CX_ERR_LBL:
-	_cx_free (newAttr->attrName);
-	_cx_free (newAttr->attrValue);
-	return xStatus;
+cx_status_t _cx_AddAttrToNode (void *_cookie, char *attrName, cxa_value_u *value, cxattr_type_t type, char *nodeName)
+{
+	cx_rfail (!nodeName, CX_ERR_NULL_NODENAME);
+
+	return _cx_BuildAttr (_cookie, cx_FindNodeWithTag (_cookie, nodeName), \
+			attrName, value, type);
 }
 #endif
 
+/*Nothing follows node in document order, so tag index can just append it*/
+static inline int isDocTail (cx_cookie_t *cookie, cx_node_t *node)
+{
+	for (; node; node = _cx_Node (cookie, node->parent)) {
+		if (node->next) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /**
- * @func   : _cx_AddNode
- * @brief  : adds a new node to tree
- * @called : when populating tree with a new node as child/next/first
- * @input  : char *new - tagField for tagName/content/cdata/comment
- *           char *addTo - tagField for previous node to which new one is added
- *                       Required so that user can properly populate nodes
- *           cxn_type_t nodeType - type of new node
+ * @func   : nodeTableOrder
+ * @brief  : keep node table in document order for a node going at its end,
+ *           or mark it unordered
+ * @called : by _cx_BuildNode before a new node is added
+ * @input  : cx_cookie_t *cookie - session being built
+ *           cx_node_t *at - node the new one is added to, NULL for root
  *           cx_Addtype_t addType - to add as child/next/first node
  * @output : none
- * @return : CX_SUCCESS/CX_ERR_BAD_NODETYPE/
- * 			 CX_ERR_NULL_PTR/CX_ERR_ALLOC/CX_ERR_BAD_NODE/CX_FAILURE
+ * @return : void
+ * Open nodes (end 0) are the last node of table and its ancestors. New node
+ * follows the last one in document order iff it is added to an open node;
+ * open nodes below its parent are complete then. Each node is closed once,
+ * so this is O(1) amortised
  */
-cx_status_t _cx_AddNode (void *_cookie, const char *new, cxn_type_t nodeType, const char *addTo, cx_Addtype_t addType)
+static void nodeTableOrder (cx_cookie_t *cookie, cx_node_t *at, \
+		cx_Addtype_t addType)
 {
-	/*give CX_SUCCESS if addtype is valid*/
-#define BAD_ADDTYPE_VAL(type) \
-	((type <= CXADD_MINTYPE) || (type >= CXADD_MAXTYPE))
-#define INVALID_POPULATING(type) \
-	((type != CXADD_CHILD) && (type != CXADD_NEXT))
+	cx_nodetbl_t *tbl = &cookie->nodes;
+	cx_node_t *open;
+	uint32_t parent;
+
+	if (tbl->unordered || !at) {
+		return;
+	}
+	if (at->end) {
+		tbl->unordered = 1;
+		return;
+	}
+	parent = (addType == CXADD_CHILD) ? at->self : at->parent;
+	for (open = _cx_Node (cookie, tbl->nNodes - 1); open && \
+			(open->self != parent); open = _cx_Node (cookie, open->parent)) {
+		open->end = tbl->nNodes;
+	}
+}
 
+/**
+ * @func   : _cx_BuildNode
+ * @brief  : adds a new node to tree relative to a node handle, without
+ *           any lookups
+ * @called : by cx_BuildXxx with node handles user got from earlier adds,
+ *           and by _cx_AddNode once it has resolved addTo
+ * @input  : void *_cookie - pointer to select xml-context
+ *           const char *new - tagField for tagName/content/cdata/comment
+ *           cxn_type_t nodeType - type of new node
+ *           cx_node_t *at - node of this session the new one is added to,
+ *                           as its last child (at must be a PARENT node)
+ *                           or right next to it; NULL for CXADD_FIRST
+ *           cx_Addtype_t addType - to add as child/next/first node
+ * @output : cx_node_t **node - handle of new node, if not NULL
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+cx_status_t _cx_BuildNode (void *_cookie, const char *new, cxn_type_t nodeType, cx_node_t *at, cx_Addtype_t addType, cx_node_t **node)
+{
 	cx_node_t *newNode = NULL;
 	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
-	cx_node_t *prevNode;
-	cx_status_t xStatus = CX_SUCCESS;
+	const char *symName = NULL;
+	cx_status_t xStatus;
 
+	cx_null_rfail (cookie);
+	cx_func_rfail (_cx_LazyBuild (cookie));
 	cx_rfail (IS_INVALID_NODE_TYPE(nodeType), CX_ERR_INVALID_NODE);
-
-	cx_null_lfail (new);
-
+	cx_null_rfail (new);
 	cx_rfail (BAD_ADDTYPE_VAL(addType), CX_ERR_INVALID_NEW_NODE);
+	if (addType == CXADD_FIRST) {
+		cx_rfail ((cookie->root != NULL), CX_ERR_ROOT_FILLED);
+	} else {
+		cx_rfail (!at, CX_ERR_NODE_NOT_FOUND);
+		cx_rfail ((addType == CXADD_CHILD) && (at->nodeType != CXN_PARENT), \
+				CX_ERR_INVALID_NODE);
+	}
 
 	cx_enc_dbg ("newNode: %s\r\n", new);
 
-	_cx_calloc (newNode, sizeof (cx_node_t));
+	nodeTableOrder (cookie, at, addType);
+	newNode = _cx_NewNode (cookie);
 	cx_alloc_rfail (newNode);
 
-	newNode->tagField = _cx_strndup ((char *)new, strlen (new), (char *)new);
-	cx_alloc_lfail (newNode->tagField);
+	newNode->tagLen = strlen (new);
+	if (IS_ELEMENT_TYPE (nodeType)) {
+		newNode->symId = _cx_SymIntern (new, newNode->tagLen, &symName);
+	}
+	newNode->tagField = newNode->symId ? (char *)symName : \
+		_cx_strndup (&cookie->arena, new, newNode->tagLen);
+	cx_alloc_rfail (newNode->tagField);
 
 	newNode->nodeType = nodeType;
 
 	if (addType == CXADD_FIRST) {
-		cx_lfail ((cookie->root != NULL), CX_ERR_ROOT_FILLED);
 		/*Xml Origins: root-node*/
-		cookie->root = cookie->recent = newNode;
+		cookie->root = newNode;
+		cookie->xmlLength = XML_VERSTRING_LEN;
 		cx_enc_dbg ("\"%s\" is root-node\n", newNode->tagField);
-		return CX_SUCCESS;
-	}
-
-	/*If not first node, addTo is expected to be valid pointer*/
-	cx_null_lfail (addTo);
-
-	prevNode = cookie->recent;
-
-	if (CX_SUCCESS != strcmp (addTo, prevNode->tagField)) {
-	   	if (CX_SUCCESS == strcmp (addTo, prevNode->parent->tagField)) {
-			cx_enc_dbg ("adding %s to a prev parent: %s\n", \
-					new, prevNode->parent->tagField);
-			prevNode = prevNode->parent;
-		} else { /*just don't use cx_lfail API, current is good to debug*/
-			cx_enc_dbg ("don't know :%s..%s..%s\n", \
-					addTo, new, prevNode->tagField);
-			xStatus = CX_ERR_ESTRANGED_NODE;
-			goto CX_ERR_LBL;
-		}
-	}
-
-	if (addType == CXADD_CHILD) {
+	} else if (addType == CXADD_CHILD) {
 		/*If asked to be added as child, add it to child list my mother!*/
-		cx_enc_dbg ("adding %s as child to %s\n", new, addTo);
-		if (prevNode->children) {
+		cx_enc_dbg ("adding %s as child to %.*s\n", new, at->tagLen, \
+				at->tagField);
+		if (at->children) {
 			/*Add the new born as the last one*/
-			prevNode->lastChild->next = newNode;
+			_cx_Node (cookie, at->lastChild)->next = newNode->self;
 		} else {
 			/*New born is the first born */
-			prevNode->children = newNode;
+			at->children = newNode->self;
 		}
-		prevNode->lastChild = newNode;
-		newNode->parent = prevNode;
+		at->lastChild = newNode->self;
+		newNode->parent = at->self;
 	} else {
-		if (prevNode->next) {
-			xStatus = CX_ERR_NEXT_NODE_FILLED;
-			goto CX_ERR_LBL;
+		cx_enc_dbg ("adding %s next to %.*s\n", new, at->tagLen, \
+				at->tagField);
+		cx_node_t *parent = _cx_Node (cookie, at->parent);
+
+		newNode->parent = at->parent;
+		newNode->next = at->next;
+		at->next = newNode->self;
+		if (parent && (parent->lastChild == at->self)) {
+			parent->lastChild = newNode->self;
 		}
-		cx_enc_dbg ("adding %s next to %s\n", new, addTo);
-		newNode->parent = prevNode->parent;
-		prevNode->next = newNode;
 	}
 
 	cookie->recent = newNode;
+	if (cookie->tagIdx.bucket) {
+		if (!cookie->nodes.unordered || isDocTail (cookie, newNode)) {
+			_cx_TagIndexAdd (cookie, newNode);
+		} else {
+			/*index is in document order, rebuild it on next lookup*/
+			memset (&cookie->tagIdx, 0, sizeof (cookie->tagIdx));
+		}
+	}
+	cookie->xmlLength += NODE_ENC_LEN (nodeType, newNode->tagLen);
+	cx_enc_dbg ("now prev: %s\n", newNode->tagField);
 
-CX_ERR_LBL:
-	if (xStatus != CX_SUCCESS) {
-		_cx_free (newNode->tagField);
-		_cx_free (newNode);
-	} else { /*No failure*/
-		cx_enc_dbg ("now prev: %s\n", newNode->tagField);
+	if (node) {
+		*node = newNode;
 	}
-	return xStatus;
+
+	return CX_SUCCESS;
 }
 
+/**
+ * @func   : _cx_AddNode
+ * @brief  : adds a new node to tree
+ * @called : when populating tree with a new node as child/next/first
+ * @input  : char *new - tagField for tagName/content/cdata/comment
+ *           char *addTo - tagField for previous node to which new one is added
+ *                       Required so that user can properly populate nodes;
+ *                       it must be the most recently added node or its parent
+ *           cxn_type_t nodeType - type of new node
+ *           cx_Addtype_t addType - to add as child/next/first node
+ * @output : none
+ * @return : CX_SUCCESS/CX_ERR_BAD_NODETYPE/
+ * 			 CX_ERR_NULL_PTR/CX_ERR_ALLOC/CX_ERR_BAD_NODE/CX_FAILURE
+ */
+cx_status_t _cx_AddNode (void *_cookie, const char *new, cxn_type_t nodeType, const char *addTo, cx_Addtype_t addType)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	cx_node_t *prevNode = NULL;
+
+	cx_null_rfail (cookie);
+	cx_rfail (BAD_ADDTYPE_VAL(addType), CX_ERR_INVALID_NEW_NODE);
+
+	if (addType != CXADD_FIRST) {
+		/*If not first node, addTo is expected to be valid pointer*/
+		cx_null_rfail (addTo);
+		prevNode = cookie->recent;
+		cx_rfail (!prevNode, CX_ERR_NODE_NOT_FOUND);
+
+		if (CX_SUCCESS != strcmp (addTo, prevNode->tagField)) {
+			cx_node_t *parent = _cx_Node (cookie, prevNode->parent);
+
+			if (parent && (CX_SUCCESS == strcmp (addTo, parent->tagField))) {
+				cx_enc_dbg ("adding %s to a prev parent: %s\n", \
+						new, parent->tagField);
+				prevNode = parent;
+			} else { /*just don't use cx_lfail API, current is good to debug*/
+				cx_enc_dbg ("don't know :%s..%s..%s\n", \
+						addTo, new, prevNode->tagField);
+				return CX_ERR_ESTRANGED_NODE;
+			}
+		}
+		/*by name, nodes are only appended; handles can insert in between*/
+		cx_rfail ((addType == CXADD_NEXT) && prevNode->next, \
+				CX_ERR_NEXT_NODE_FILLED);
+	}
+
+	return _cx_BuildNode (cookie, new, nodeType, prevNode, addType, NULL);
+}
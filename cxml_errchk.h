@@ -24,6 +24,111 @@
 #define cx_dec_dbg(...)
 #endif
 
+#if CX_USING_TRACE
+#include <stdint.h>
+
+/* Trace events, with what their arguments hold; off is offset in the xml
+ * string, status a cx_status_t. Only add at end, dumps refer to them by
+ * position */
+#define CX_TRACE_EVENTS(X) \
+	X (DEC_BEGIN)    /*len - size limit/length, aux - threads*/ \
+	X (DEC_NODE)     /*type - cxn_type_t, off/len - tag name/contents*/ \
+	X (DEC_ATTR)     /*off - attr name, len - value length*/ \
+	X (DEC_SPLIT)    /*len - chunk size, aux - chunks*/ \
+	X (DEC_CHUNK)    /*status, off/len - chunk, aux - its index*/ \
+	X (DEC_FALLBACK) /*status - why parallel decoding gave up*/ \
+	X (DEC_END)      /*status, len - bytes consumed*/ \
+	X (ENC_BEGIN)    /*len - length of xml string, aux - threads*/ \
+	X (ENC_END)      /*status, len - bytes written*/ \
+	X (FIND)         /*status, len - length of tag name*/ \
+	X (INDEX)        /*len - nodes indexed*/ \
+	X (ARENA_BLK)    /*len - size of new arena block*/ \
+	X (SAX_FEED)     /*status, len - bytes fed, aux - depth after them*/ \
+	X (DEC_LAZY)     /*status, off/len - part built, aux - its element*/ \
+	X (QUERY)        /*status, len - steps of query, aux - elements tested*/
+
+#define CX_TEV_ENUM(name) CX_TEV_##name,
+typedef enum {
+	CX_TRACE_EVENTS (CX_TEV_ENUM)
+	CX_TEV_MAX,
+} cx_tev_t;
+#undef CX_TEV_ENUM
+
+/**
+ * An event in trace ring, three 64-bit words so that a dump reading a ring
+ * being written never sees half of a word
+ * ts - timestamp ticks, see cx_tracehdr_t
+ * info - event (bits 0-15), type (16-23), status (24-31), aux (32-63)
+ * arg - off (bits 0-31), len (32-63)
+ */
+typedef struct cx_tracerec_s {
+	uint64_t            ts;
+	uint64_t            info;
+	uint64_t            arg;
+} cx_tracerec_t;
+
+/**
+ * Head of a trace dump; each ring follows as a cx_traceringhdr_t and its
+ * records, oldest first
+ * magic, version, recSz - CX_TRACE_MAGIC, 1, sizeof (cx_tracerec_t)
+ * nRings - rings in the dump
+ * ts0, ns0, ts1, ns1 - ticks and CLOCK_MONOTONIC ns at tracing start and at
+ *                      dump, to turn ticks of records into ns
+ */
+typedef struct cx_tracehdr_s {
+#define CX_TRACE_MAGIC 0x52545843 /*"CXTR"*/
+	uint32_t            magic;
+	uint16_t            version;
+	uint16_t            recSz;
+	uint32_t            nRings;
+	uint32_t            rsvd;
+	uint64_t            ts0;
+	uint64_t            ns0;
+	uint64_t            ts1;
+	uint64_t            ns1;
+} cx_tracehdr_t;
+
+/**
+ * tid - kernel thread ID of ring's thread
+ * nRecs - records following, upto CX_TRACE_RING_SZ
+ * dropped - older events overwritten before the dump
+ */
+typedef struct cx_traceringhdr_s {
+	uint32_t            tid;
+	uint32_t            nRecs;
+	uint64_t            dropped;
+} cx_traceringhdr_t;
+
+extern int _cx_TraceOn;
+
+void _cx_TraceRec (uint32_t ev, uint32_t type, uint32_t status, \
+		uint32_t off, uint32_t len, uint32_t aux);
+
+void _cx_TraceFailed (void);
+
+/* Costs a load and a branch while tracing is off, a timestamp and three
+ * stores into a thread's own ring while on */
+#define cx_trace(ev, type, status, off, len, aux) \
+	do { \
+		if (__builtin_expect (__atomic_load_n (&_cx_TraceOn, \
+						__ATOMIC_RELAXED), 0)) { \
+			_cx_TraceRec (CX_TEV_##ev, type, status, off, len, aux); \
+		} \
+	} while (0)
+
+/*A call is failing, rings are dumped if cx_TraceDumpOnError asked for it*/
+#define cx_trace_failed() \
+	do { \
+		if (__builtin_expect (__atomic_load_n (&_cx_TraceOn, \
+						__ATOMIC_RELAXED), 0)) { \
+			_cx_TraceFailed (); \
+		} \
+	} while (0)
+#else
+#define cx_trace(...)
+#define cx_trace_failed()
+#endif
+
 #define cx_rfail(failed, errCode) \
 	do { \
 		if (failed) { \
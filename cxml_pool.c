@@ -0,0 +1,298 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_POOL
+
+/**
+ * Items of a run handed to one worker upfront. Owner takes them front
+ * to back, and so do other workers once they are done with their own; all
+ * of them just atomically bump next, so each item is taken exactly once
+ * next - next item to take, may go beyond end
+ * end - item after the last one of this range
+ */
+typedef struct cx_poolrange_s {
+	uint32_t            next;
+	uint32_t            end;
+} __attribute__((aligned (64))) cx_poolrange_t;
+
+/**
+ * A _cx_PoolRun call being worked on
+ * job, arg - as given to _cx_PoolRun
+ * nWorkers - calling thread and pool threads 1..nWorkers-1 taking part
+ * range - items of each worker
+ */
+typedef struct cx_poolrun_s {
+	cx_job_t            job;
+	void                *arg;
+	uint32_t            nWorkers;
+	cx_poolrange_t      range[CX_POOL_MAX_THREADS];
+} cx_poolrun_t;
+
+/**
+ * A cx_DecBatch call being worked on
+ * inputs, cookies, status, decFlags - as given to _cx_DecBatch
+ * failed - lowest index of a packet which failed (upper 32 bits) and its
+ *          status (lower 32 bits), UINT64_MAX if none
+ */
+typedef struct cx_batch_s {
+	char                **inputs;
+	void                **cookies;
+	cx_status_t         *status;
+	uint32_t            decFlags;
+	uint64_t            failed;
+} cx_batch_t;
+
+/**
+ * Worker threads, started on first need and kept across batches
+ * runLock - only one run goes on the pool at a time
+ * lock - guards all below
+ * wake - thread[i] waits on wake[i] for a run it takes part in, or stop
+ * done - calling thread waits on it for pool threads to finish a run
+ * nThreads - pool threads started, thread[i] works as worker i + 1
+ * gen - bumped for every run, so a worker doesn't work on one twice
+ * startGen - gen when thread[i] was started, runs after it are its own
+ * runGen - gen of latest run thread[i] takes part in; a run narrower than
+ *          the pool wakes its own workers only, as only they are counted
+ *          in busy and so only they can be sure that run is still there
+ * busy - pool threads yet to finish current run
+ */
+static struct {
+	pthread_mutex_t     runLock;
+	pthread_mutex_t     lock;
+	pthread_cond_t      wake[CX_POOL_MAX_THREADS];
+	pthread_cond_t      done;
+	pthread_t           thread[CX_POOL_MAX_THREADS];
+	uint32_t            startGen[CX_POOL_MAX_THREADS];
+	uint32_t            runGen[CX_POOL_MAX_THREADS];
+	uint32_t            nThreads;
+	uint32_t            gen;
+	uint32_t            busy;
+	int                 stop;
+	cx_poolrun_t        *run;
+} cxPool = {
+	.runLock = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = { [0 ... CX_POOL_MAX_THREADS - 1] = PTHREAD_COND_INITIALIZER },
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static void batchDecodeOne (void *arg, uint32_t i)
+{
+	cx_batch_t *b = (cx_batch_t *)arg;
+	cx_status_t xStatus;
+	uint64_t failed, mine;
+
+	/*sessions are reused if given, a worker owns the packet's session*/
+	xStatus = _cx_DecPkt (&b->cookies[i], b->inputs[i], "batch", \
+			b->decFlags | CXDEC_REUSE);
+	if (b->status) {
+		b->status[i] = xStatus;
+	}
+	if (xStatus != CX_SUCCESS) {
+		mine = ((uint64_t)i << 32) | (uint32_t)xStatus;
+		failed = __atomic_load_n (&b->failed, __ATOMIC_RELAXED);
+		while ((mine < failed) && !__atomic_compare_exchange_n (&b->failed, \
+					&failed, mine, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	}
+}
+
+/*Own items first, then steal from the others, each in turn*/
+static void poolWork (cx_poolrun_t *run, uint32_t self)
+{
+	cx_poolrange_t *r;
+	uint32_t v, i;
+
+	for (v = 0; v < run->nWorkers; v++) {
+		r = &run->range[(self + v) % run->nWorkers];
+		while ((i = __atomic_fetch_add (&r->next, 1, __ATOMIC_RELAXED)) < \
+				r->end) {
+			run->job (run->arg, i);
+		}
+	}
+}
+
+static void *poolWorker (void *arg)
+{
+	uint32_t self = (uint32_t)(uintptr_t)arg, seen;
+	cx_poolrun_t *run;
+
+	pthread_mutex_lock (&cxPool.lock);
+	/*run which started this thread may have begun before it does*/
+	seen = cxPool.startGen[self - 1];
+	while (1) {
+		while ((cxPool.runGen[self - 1] == seen) && !cxPool.stop) {
+			pthread_cond_wait (&cxPool.wake[self - 1], &cxPool.lock);
+		}
+		if (cxPool.stop) {
+			break;
+		}
+		seen = cxPool.runGen[self - 1];
+		/*counted in busy, run stays till this thread is done with it*/
+		run = cxPool.run;
+		pthread_mutex_unlock (&cxPool.lock);
+		poolWork (run, self);
+		pthread_mutex_lock (&cxPool.lock);
+		if (!--cxPool.busy) {
+			pthread_cond_signal (&cxPool.done);
+		}
+	}
+	pthread_mutex_unlock (&cxPool.lock);
+
+	return NULL;
+}
+
+/*Start pool threads upto nWorkers - 1, gives the number of workers usable*/
+static uint32_t poolGrow (uint32_t nWorkers)
+{
+	while (cxPool.nThreads < (nWorkers - 1)) {
+		cxPool.startGen[cxPool.nThreads] = cxPool.gen;
+		cxPool.runGen[cxPool.nThreads] = cxPool.gen;
+		if (pthread_create (&cxPool.thread[cxPool.nThreads], NULL, \
+					poolWorker, (void *)(uintptr_t)(cxPool.nThreads + 1))) {
+			/*do with the ones running*/
+			return cxPool.nThreads + 1;
+		}
+		cxPool.nThreads++;
+	}
+
+	return nWorkers;
+}
+
+/**
+ * @func   : _cx_PoolThreads
+ * @brief  : number of threads a run asking for nThreads can have
+ * @called : to size work upfront, before it's handed to _cx_PoolRun
+ * @input  : uint32_t nThreads - most threads wanted, 0 for one per online cpu
+ * @output : none
+ * @return : nThreads, or number of online cpus for 0, upto
+ *           CX_POOL_MAX_THREADS
+ */
+uint32_t _cx_PoolThreads (uint32_t nThreads)
+{
+	long nCpu;
+
+	if (!nThreads) {
+		nCpu = sysconf (_SC_NPROCESSORS_ONLN);
+		nThreads = (nCpu > 0) ? (uint32_t)nCpu : 1;
+	}
+
+	return (nThreads > CX_POOL_MAX_THREADS) ? CX_POOL_MAX_THREADS : nThreads;
+}
+
+/**
+ * @func   : _cx_PoolRun
+ * @brief  : run a job for items 0..n-1 on the worker pool, starting pool
+ *           threads as needed, and wait for all of them to be done
+ * @called : by APIs spreading their work over cores, e.g. cx_DecBatch;
+ *           never from within a job, it would wait for itself
+ * @input  : cx_job_t job - called once for each item, from any worker
+ *           void *arg - passed to job as is
+ *           uint32_t n - number of items
+ *           uint32_t nThreads - most threads to use, calling thread
+ *                               included; 0 for one per online cpu
+ * @output : none
+ * @return : void
+ */
+void _cx_PoolRun (cx_job_t job, void *arg, uint32_t n, uint32_t nThreads)
+{
+	cx_poolrun_t run;
+	uint32_t w, per, extra, start;
+
+	if (!n) {
+		return;
+	}
+	nThreads = _cx_PoolThreads (nThreads);
+	if (nThreads > n) {
+		nThreads = n;
+	}
+
+	run.job = job;
+	run.arg = arg;
+
+	pthread_mutex_lock (&cxPool.runLock);
+	pthread_mutex_lock (&cxPool.lock);
+	run.nWorkers = poolGrow (nThreads);
+
+	/*even split, stealing evens out items of uneven cost*/
+	per = n / run.nWorkers;
+	extra = n % run.nWorkers;
+	for (w = 0, start = 0; w < run.nWorkers; w++) {
+		run.range[w].next = start;
+		start += per + (w < extra);
+		run.range[w].end = start;
+	}
+
+	if (run.nWorkers > 1) {
+		cxPool.run = &run;
+		cxPool.busy = run.nWorkers - 1;
+		cxPool.gen++;
+		for (w = 1; w < run.nWorkers; w++) {
+			cxPool.runGen[w - 1] = cxPool.gen;
+			pthread_cond_signal (&cxPool.wake[w - 1]);
+		}
+	}
+	pthread_mutex_unlock (&cxPool.lock);
+
+	/*calling thread is worker 0*/
+	poolWork (&run, 0);
+
+	pthread_mutex_lock (&cxPool.lock);
+	while (cxPool.busy) {
+		pthread_cond_wait (&cxPool.done, &cxPool.lock);
+	}
+	cxPool.run = NULL;
+	pthread_mutex_unlock (&cxPool.lock);
+	pthread_mutex_unlock (&cxPool.runLock);
+}
+
+cx_status_t _cx_DecBatch (char *inputs[], uint32_t n, void *cookies[], cx_status_t status[], uint32_t nThreads, uint32_t decFlags)
+{
+	cx_batch_t batch;
+
+	cx_null_rfail (inputs);
+	cx_null_rfail (cookies);
+	cx_rfail ((n > (UINT32_MAX - CX_POOL_MAX_THREADS)), CX_ERR_DEC_OVERFLOW);
+
+	batch.inputs = inputs;
+	batch.cookies = cookies;
+	batch.status = status;
+	batch.decFlags = decFlags & ~CXDEC_REUSE;
+	batch.failed = UINT64_MAX;
+
+	_cx_PoolRun (batchDecodeOne, &batch, n, nThreads);
+
+	return (batch.failed == UINT64_MAX) ? CX_SUCCESS : \
+		(cx_status_t)(uint32_t)batch.failed;
+}
+
+void cx_PoolDestroy (void)
+{
+	uint32_t i;
+
+	pthread_mutex_lock (&cxPool.runLock);
+	pthread_mutex_lock (&cxPool.lock);
+	cxPool.stop = 1;
+	for (i = 0; i < cxPool.nThreads; i++) {
+		pthread_cond_signal (&cxPool.wake[i]);
+	}
+	pthread_mutex_unlock (&cxPool.lock);
+
+	for (i = 0; i < cxPool.nThreads; i++) {
+		pthread_join (cxPool.thread[i], NULL);
+	}
+
+	pthread_mutex_lock (&cxPool.lock);
+	cxPool.nThreads = 0;
+	cxPool.stop = 0;
+	pthread_mutex_unlock (&cxPool.lock);
+	pthread_mutex_unlock (&cxPool.runLock);
+}
+
+#endif /*CX_USING_POOL*/
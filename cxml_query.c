@@ -0,0 +1,436 @@
+
+#include <stdio.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_QUERY
+
+/**
+ * An attr test of a query
+ * name, nameLen - attr name
+ * value, valueLen - value attr must have, NULL if it just has to be there
+ */
+typedef struct cx_qattr_s {
+	const char          *name;
+	uint32_t            nameLen;
+	const char          *value;
+	uint32_t            valueLen;
+} cx_qattr_t;
+
+/**
+ * A step of a query
+ * name, len - tag name, NULL for any tag
+ * isDesc - element may be anywhere under the one of previous step, not just
+ *          one of its children
+ * pos - position among children of same parent passing tests before it,
+ *       from 1; 0 for none
+ * before, after - attr tests, as bits of attr[] of query, to pass before
+ *                 and after position is taken
+ */
+typedef struct cx_qstep_s {
+	const char          *name;
+	uint32_t            len;
+	int                 isDesc;
+	uint32_t            pos;
+	uint32_t            before;
+	uint32_t            after;
+} cx_qstep_t;
+
+/**
+ * A compiled query
+ * nSteps, step - steps, from top level down
+ * nAttrs, attr - attr tests of all steps
+ * sel - attr[] index of attr selected, plus 1; 0 if query is of elements
+ * path - copy of the path, names of steps and tests point into it
+ */
+struct cx_query_s {
+	uint32_t            nSteps;
+	cx_qstep_t          step[CX_QUERY_MAX_STEPS];
+	uint32_t            nAttrs;
+	cx_qattr_t          attr[CX_QUERY_MAX_ATTRS];
+	uint32_t            sel;
+	char                path[];
+};
+
+_Static_assert (CX_QUERY_MAX_STEPS <= 32, \
+		"CX_QUERY_MAX_STEPS must fit in a uint32_t mask");
+_Static_assert (CX_QUERY_MAX_ATTRS <= 32, \
+		"CX_QUERY_MAX_ATTRS must fit in a uint32_t mask");
+
+/**
+ * An element whose children a query is tested on
+ * act - steps its children are tested against, as bits
+ * cnt - its children counted so far for position of each step
+ */
+typedef struct cx_qframe_s {
+	uint32_t            act;
+	uint32_t            cnt[CX_QUERY_MAX_STEPS];
+} cx_qframe_t;
+
+/*Past a name in a path*/
+static const char *pathName (const char *s)
+{
+	while (*s && !strchr ("/[]@=*'\" \t\r\n", *s)) {
+		s++;
+	}
+	return s;
+}
+
+/*Parse an attr test at name of it, "k" or "k='v'", into next attr[]*/
+static cx_status_t queryParseAttr (cx_query_t *q, const char **_s)
+{
+	const char *s = *_s;
+	cx_qattr_t *qa;
+	char quote;
+
+	cx_rfail ((q->nAttrs == CX_QUERY_MAX_ATTRS), CX_ERR_INVALID_QUERY);
+	qa = &q->attr[q->nAttrs++];
+	qa->name = s;
+	s = pathName (s);
+	cx_rfail ((s == qa->name), CX_ERR_INVALID_QUERY);
+	qa->nameLen = (uint32_t)(s - qa->name);
+	if (*s == '=') {
+		quote = *++s;
+		cx_rfail ((quote != '\'') && (quote != '"'), CX_ERR_INVALID_QUERY);
+		qa->value = ++s;
+		while (*s && (*s != quote)) {
+			s++;
+		}
+		cx_rfail (!*s, CX_ERR_INVALID_QUERY);
+		qa->valueLen = (uint32_t)(s - qa->value);
+		s++;
+	}
+	*_s = s;
+
+	return CX_SUCCESS;
+}
+
+/*Parse a path into steps and attr tests of a query*/
+static cx_status_t queryParse (cx_query_t *q, const char *s)
+{
+	cx_status_t xStatus;
+	cx_qstep_t *st;
+	uint64_t pos;
+	int isDesc;
+
+	s += (*s == '/');
+	isDesc = (*s == '/');
+	s += isDesc;
+	while (1) {
+		if (*s == '@') {
+			/*attr of elements of previous step, and nothing after it*/
+			cx_rfail (!q->nSteps || isDesc, CX_ERR_INVALID_QUERY);
+			s++;
+			cx_func_rfail (queryParseAttr (q, &s));
+			cx_rfail (*s || q->attr[q->nAttrs - 1].value, CX_ERR_INVALID_QUERY);
+			q->step[q->nSteps - 1].after |= 1U << (q->nAttrs - 1);
+			q->sel = q->nAttrs;
+			break;
+		}
+
+		cx_rfail ((q->nSteps == CX_QUERY_MAX_STEPS), CX_ERR_INVALID_QUERY);
+		st = &q->step[q->nSteps++];
+		st->isDesc = isDesc;
+		if (*s == '*') {
+			s++;
+		} else {
+			st->name = s;
+			s = pathName (s);
+			cx_rfail ((s == st->name), CX_ERR_INVALID_QUERY);
+			st->len = (uint32_t)(s - st->name);
+		}
+
+		/*tests, [n], [@k] or [@k='v']*/
+		while (*s == '[') {
+			s++;
+			if (*s == '@') {
+				s++;
+				cx_func_rfail (queryParseAttr (q, &s));
+				*(st->pos ? &st->after : &st->before) |= 1U << (q->nAttrs - 1);
+			} else {
+				cx_rfail (st->pos || (*s < '1') || (*s > '9'), \
+						CX_ERR_INVALID_QUERY);
+				for (pos = 0; (*s >= '0') && (*s <= '9'); s++) {
+					pos = (pos * 10) + (uint64_t)(*s - '0');
+					cx_rfail ((pos > UINT32_MAX), CX_ERR_INVALID_QUERY);
+				}
+				st->pos = (uint32_t)pos;
+			}
+			cx_rfail ((*s != ']'), CX_ERR_INVALID_QUERY);
+			s++;
+		}
+
+		if (!*s) {
+			break;
+		}
+		cx_rfail ((*s != '/'), CX_ERR_INVALID_QUERY);
+		s++;
+		isDesc = (*s == '/');
+		s += isDesc;
+	}
+
+	return CX_SUCCESS;
+}
+
+cx_status_t cx_QueryCompile (cx_query_t **query, const char *path)
+{
+	cx_status_t xStatus;
+	cx_query_t *q;
+	size_t len;
+
+	cx_null_rfail (query);
+	cx_null_rfail (path);
+
+	len = strlen (path);
+	_cx_calloc (q, sizeof (cx_query_t) + len + 1);
+	cx_alloc_rfail (q);
+	memcpy (q->path, path, len);
+
+	xStatus = queryParse (q, q->path);
+	if (xStatus != CX_SUCCESS) {
+		free (q);
+		return xStatus;
+	}
+	*query = q;
+
+	return CX_SUCCESS;
+}
+
+void cx_QueryDestroy (cx_query_t *query)
+{
+	free (query);
+}
+
+/*Does an attr pass an attr test?*/
+static inline int queryAttrOk (const cx_qattr_t *qa, const char *name, \
+		uint32_t nameLen, const char *value, uint64_t valueLen)
+{
+	return (qa->nameLen == nameLen) && !memcmp (qa->name, name, nameLen) && \
+		(!qa->value || ((qa->valueLen == valueLen) && \
+						!memcmp (qa->value, value, valueLen)));
+}
+
+/*Bits of attr tests of a query an attr passes*/
+static inline uint32_t queryAttr (const cx_query_t *q, const char *name, \
+		uint32_t nameLen, const char *value, uint64_t valueLen)
+{
+	uint32_t i, ok = 0;
+
+	for (i = 0; i < q->nAttrs; i++) {
+		if (queryAttrOk (&q->attr[i], name, nameLen, value, valueLen)) {
+			ok |= 1U << i;
+		}
+	}
+	return ok;
+}
+
+/**
+ * @func   : queryTest
+ * @brief  : test an element against the steps its parent's children are
+ *           tested against, counting it for their positions
+ * @called : for every element in document order, as long as its parent
+ *           has steps to be tested against
+ * @input  : const cx_query_t *q - query
+ *           cx_qframe_t *fr - frame of parent of the element
+ *           const char *name, uint32_t len - tag name of the element
+ *           uint32_t attrOk - attr tests the element passes, as bits
+ * @output : uint32_t *childAct - steps children of the element are to be
+ *                                tested against
+ * @return : 1 if the element matches the whole query, 0 otherwise
+ */
+static int queryTest (const cx_query_t *q, cx_qframe_t *fr, \
+		const char *name, uint32_t len, uint32_t attrOk, uint32_t *childAct)
+{
+	const cx_qstep_t *st;
+	uint32_t act, k;
+
+	*childAct = 0;
+	for (act = fr->act; act; act &= act - 1) {
+		k = (uint32_t)__builtin_ctz (act);
+		st = &q->step[k];
+		if (st->isDesc) {
+			/*a descendant step goes on being tested further down*/
+			*childAct |= 1U << k;
+		}
+		if ((st->name && ((st->len != len) || memcmp (st->name, name, len))) || \
+				((attrOk & st->before) != st->before) || \
+				(st->pos && (++fr->cnt[k] != st->pos)) || \
+				((attrOk & st->after) != st->after)) {
+			continue;
+		}
+		if (k == (q->nSteps - 1)) {
+			return 1;
+		}
+		*childAct |= 1U << (k + 1);
+	}
+
+	return 0;
+}
+
+/*Start testing children of an element against steps act*/
+static inline void queryFrame (cx_qframe_t *fr, uint32_t act)
+{
+	fr->act = act;
+	memset (fr->cnt, 0, sizeof (fr->cnt));
+}
+
+/*Bits of attr tests of a query a node passes*/
+static uint32_t queryNodeAttrs (const cx_query_t *q, const cx_node_t *node)
+{
+	uint32_t ok = 0;
+#if CX_USING_TAG_ATTR
+	const cxn_attr_t *attr;
+
+	if (!q->nAttrs) {
+		return 0;
+	}
+	for (attr = node->attrList; attr; attr = attr->next) {
+		ok |= queryAttr (q, attr->attrName, attr->nameLen, \
+				attr->attrValue, attr->valueLen);
+	}
+#else
+	(void)q;
+	(void)node;
+#endif
+	return ok;
+}
+
+cx_status_t cx_QueryRun (void *_cookie, const cx_query_t *query, cx_node_t **node, const char **value, uint32_t *valueLen)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	cx_status_t xStatus;
+	/*stk[0] is the document, its top level elements are tested first*/
+	cx_qframe_t stk[CX_QUERY_MAX_DEPTH + 1], *fr = stk;
+	cx_node_t *curNode;
+	uint32_t childAct, nTested = 0;
+#if CX_USING_TAG_ATTR
+	const cxn_attr_t *attr;
+#endif
+
+	cx_null_rfail (cookie);
+	cx_null_rfail (query);
+	cx_null_rfail (node);
+	cx_rfail ((cookie->cxCode != CX_COOKIE_MAGIC), CX_ERR_NULL_PTR);
+	cx_func_rfail (_cx_LazyBuild (cookie));
+
+	CX_STAT_ADD (cookie, finds, 1);
+	xStatus = CX_ERR_NODE_NOT_FOUND;
+	queryFrame (fr, 1U);
+	curNode = cookie->root;
+	while (curNode) {
+		if (IS_ELEMENT (curNode)) {
+			nTested++;
+			if (queryTest (query, fr, curNode->tagField, curNode->tagLen, \
+						queryNodeAttrs (query, curNode), &childAct)) {
+				xStatus = CX_SUCCESS;
+				break;
+			}
+			/*subtrees with no step to test are not walked at all*/
+			if (childAct && curNode->children) {
+				if (fr == &stk[CX_QUERY_MAX_DEPTH]) {
+					xStatus = CX_ERR_DEC_OVERFLOW;
+					break;
+				}
+				queryFrame (++fr, childAct);
+				curNode = _cx_Node (cookie, curNode->children);
+				continue;
+			}
+		}
+		/*climb till some node has a next one*/
+		while (curNode && !curNode->next) {
+			curNode = _cx_Node (cookie, curNode->parent);
+			if (curNode) {
+				fr--;
+			}
+		}
+		if (curNode) {
+			curNode = _cx_Node (cookie, curNode->next);
+		}
+	}
+	CX_STAT_ADD (cookie, visited, nTested);
+	_cx_StatsFlush (cookie);
+	cx_trace (QUERY, 0, xStatus, 0, query->nSteps, nTested);
+	if (xStatus != CX_SUCCESS) {
+		return xStatus;
+	}
+
+	*node = curNode;
+	if (value) {
+		*value = NULL;
+	}
+	if (valueLen) {
+		*valueLen = 0;
+	}
+#if CX_USING_TAG_ATTR
+	/*a match has the attr selected, just find which one it is*/
+	for (attr = curNode->attrList; query->sel && attr; attr = attr->next) {
+		if (queryAttrOk (&query->attr[query->sel - 1], attr->attrName, \
+					attr->nameLen, attr->attrValue, attr->valueLen)) {
+			if (value) {
+				*value = attr->attrValue;
+			}
+			if (valueLen) {
+				*valueLen = attr->valueLen;
+			}
+			break;
+		}
+	}
+#endif
+
+	return CX_SUCCESS;
+}
+
+#if CX_USING_READER
+cx_status_t cx_QueryRead (cx_reader_t *rd, const cx_query_t *query, cx_event_t *ev)
+{
+	cx_status_t xStatus;
+	/*stk[d] is the element open at depth d of reader, stk[0] document*/
+	cx_qframe_t stk[CX_READER_MAX_DEPTH + 1];
+	cx_event_t start, attr, sel = {0};
+	uint32_t childAct, attrOk;
+
+	cx_null_rfail (rd);
+	cx_null_rfail (query);
+	cx_null_rfail (ev);
+	/*positions count from first of siblings, so no element can be open*/
+	cx_rfail (rd->depth, CX_ERR_INVALID_QUERY);
+
+	queryFrame (stk, 1U);
+	while (1) {
+		cx_func_rfail (cx_ReaderNext (rd, &start));
+		if (start.type == CXEV_EOF) {
+			return CX_ERR_NODE_NOT_FOUND;
+		}
+		if (start.type != CXEV_START) {
+			continue;
+		}
+		if (!stk[rd->depth - 1].act) {
+			/*nothing in its parent is looked for, nor in it*/
+			stk[rd->depth].act = 0;
+			continue;
+		}
+
+		/*attrs come before any test, as position counts on them too*/
+		attrOk = 0;
+		while (_cx_ReaderInTag (rd)) {
+			cx_func_rfail (cx_ReaderNext (rd, &attr));
+			attrOk |= queryAttr (query, attr.name, attr.nameLen, \
+					attr.value, attr.valueLen);
+			if (query->sel && (attrOk & (1U << (query->sel - 1))) && \
+					!sel.name) {
+				sel = attr;
+			}
+		}
+		if (queryTest (query, &stk[rd->depth - 1], start.name, \
+					start.nameLen, attrOk, &childAct)) {
+			*ev = query->sel ? sel : start;
+			return CX_SUCCESS;
+		}
+		sel.name = NULL;
+		queryFrame (&stk[rd->depth], childAct);
+	}
+}
+#endif /*CX_USING_READER*/
+#endif /*CX_USING_QUERY*/
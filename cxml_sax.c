@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+/*Where in the xml string the next fed byte is*/
+typedef enum {
+	SAX_LEAD,       /*before first '<', bytes are skipped as by cx_DecPkt*/
+	SAX_SPACE,      /*between tags, spaces before a text are skipped*/
+	SAX_TEXT,       /*in text of an element*/
+	SAX_LT,         /*after '<'*/
+	SAX_BANG,       /*after "<!", matching "--" or "[CDATA["*/
+	SAX_STAG,       /*in start tag name*/
+	SAX_IN_TAG,     /*in start tag, before an attr, '>' or "/>"*/
+	SAX_EMPTY_END,  /*after '/' of "/>"*/
+	SAX_ATTR_NAME,
+	SAX_ATTR_EQ,    /*after attr name, before '='*/
+	SAX_ATTR_QUOTE, /*after '=', before opening quote*/
+	SAX_ATTR_VALUE,
+	SAX_ETAG,       /*in end tag name*/
+	SAX_ETAG_END,   /*after end tag name, before '>'*/
+	SAX_COMMENT_SP, /*spaces before comment text are skipped*/
+	SAX_COMMENT,
+	SAX_CDATA,
+	SAX_INSTR,
+} cx_saxstate_t;
+
+/**
+ * Growing buffer of a streaming decoder
+ * buf - bytes held
+ * len, cap - bytes used/allocated in buf
+ */
+typedef struct cx_saxbuf_s {
+	char                *buf;
+	uint32_t            len;
+	uint32_t            cap;
+} cx_saxbuf_t;
+
+/**
+ * State of a streaming decoder, kept across the fed chunks
+ * cxCode - Fixed magic number to validate the session user has given
+ * name - name of the session
+ * cb, user - callbacks to emit and their opaque argument
+ * state - cx_saxstate_t the next byte is looked at in
+ * xStatus - first failure seen, every later feed returns it
+ * seenRoot - a top level element was seen
+ * quote - quote character of attr value being read
+ * match - characters of a "<!" prefix, tag terminator or end tag name
+ *         matched so far
+ * bang - the "<!" prefix being matched
+ * names - names of all open elements, back to back
+ * nameOff - offset of each open element's name in names, by depth
+ * depth - number of open elements
+ * tok - name of attr being read, followed by parts of its value which
+ *       arrived in earlier chunks
+ * attrNameLen - number of bytes of attr name in tok
+ */
+typedef struct cx_saxctx_s {
+#define CX_SAX_MAGIC      0x5A5CF00D
+	uint32_t            cxCode;
+	char                name[CX_COOKIE_NAMELEN];
+	cx_saxcb_t          cb;
+	void                *user;
+	uint8_t             state;
+	cx_status_t         xStatus;
+	int                 seenRoot;
+	char                quote;
+	uint32_t            match;
+	const char          *bang;
+	cx_saxbuf_t         names;
+	uint32_t            nameOff[CX_SAX_MAX_DEPTH];
+	uint32_t            depth;
+	cx_saxbuf_t         tok;
+	uint32_t            attrNameLen;
+} cx_saxctx_t;
+
+#define IS_SPACE(c) (_cx_CharClass[(uint8_t)(c)] & CX_SCAN_SPACE)
+
+#define SKIP_SPACES(ptr, end) \
+	while (((ptr) < (end)) && IS_SPACE (*(ptr))) { (ptr)++; }
+
+/*Callbacks are optional, a missing one just drops what it would get*/
+#define saxEmit(ctx, fn, ...) \
+	((ctx)->cb.fn ? (ctx)->cb.fn ((ctx)->user, ##__VA_ARGS__) : CX_SUCCESS)
+
+#define topName(ctx) ((ctx)->names.buf + (ctx)->nameOff[(ctx)->depth - 1])
+#define topNameLen(ctx) ((ctx)->names.len - (ctx)->nameOff[(ctx)->depth - 1])
+
+static inline const char *findNameEnd (const char *ptr, const char *end)
+{
+	while ((ptr < end) && \
+			!(_cx_CharClass[(uint8_t)*ptr] & (CX_SCAN_NAME_END | CX_SCAN_NUL))) {
+		ptr++;
+	}
+	return ptr;
+}
+
+/**
+ * @func   : saxAppend
+ * @brief  : append bytes to a growing buffer of streaming decoder
+ * @called : for names/values split over chunks, and names of open elements
+ * @input  : cx_saxbuf_t *sb - buffer, (re)allocated as needed
+ *           const char *src - bytes to be appended
+ *           uint32_t n - number of bytes in src
+ *           uint32_t max - bytes buf may hold at most
+ * @output : sb - updated
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t saxAppend (cx_saxbuf_t *sb, const char *src, \
+		uint32_t n, uint32_t max)
+{
+	uint32_t newCap;
+	char *tmp;
+
+	cx_rfail (((sb->len + n) > max), CX_ERR_DEC_OVERFLOW);
+	if ((sb->len + n) > sb->cap) {
+		for (newCap = sb->cap ? sb->cap : 64; newCap < (sb->len + n); newCap <<= 1);
+		tmp = realloc (sb->buf, newCap);
+		cx_alloc_rfail (tmp);
+		sb->buf = tmp;
+		sb->cap = newCap;
+	}
+	memcpy (sb->buf + sb->len, src, n);
+	sb->len += n;
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : saxTermData
+ * @brief  : stream text of a comment/cdata/instr up to its terminator,
+ *           e.g. "-->", which is never a part of the text
+ * @input  : cx_saxctx_t *ctx - streaming decoder session
+ *           const char **_ptr - next byte to look at
+ *           const char *end - end of the fed chunk
+ *           const char *term - terminator, every character but its last
+ *                              one being the same: "-->", "]]>" or "?>"
+ *           cx_saxdata_cb_t fn - callback for the text, NULL to skip it
+ * @output : const char **_ptr - next byte after the consumed ones
+ *           ctx->match - terminator characters held back at end of chunk
+ * @return : CX_SUCCESS, with ctx->state moved to SAX_SPACE once terminated
+ *           non-zero value indicating type of failure
+ */
+static cx_status_t saxTermData (cx_saxctx_t *ctx, const char **_ptr, \
+		const char *end, const char *term, cx_saxdata_cb_t fn)
+{
+	cx_status_t xStatus;
+	uint32_t termLen = (uint32_t)strlen (term);
+	const char *ptr = *_ptr, *hit;
+
+#define emitData(data, len, isLast) \
+	do { if (fn && ((len) || (isLast))) { \
+		cx_func_rfail (fn (ctx->user, data, len, isLast)); } } while (0)
+
+	while (ptr < end) {
+		if (!ctx->match) {
+			/*nothing held back, jump to next possible terminator*/
+			hit = memchr (ptr, term[0], (size_t)(end - ptr));
+			if (!hit) {
+				emitData (ptr, (uint32_t)(end - ptr), 0);
+				ptr = end;
+				break;
+			}
+			emitData (ptr, (uint32_t)(hit - ptr), 0);
+			ptr = hit + 1;
+			ctx->match = 1;
+		} else if (*ptr == term[ctx->match]) {
+			ptr++;
+			if (++ctx->match == termLen) {
+				emitData ("", 0, 1);
+				ctx->match = 0;
+				ctx->state = SAX_SPACE;
+				break;
+			}
+		} else if ((*ptr == term[0]) && (ctx->match == (termLen - 1))) {
+			/*e.g. "---", first '-' is text, "--" is still held back*/
+			emitData (term, 1, 0);
+			ptr++;
+		} else {
+			/*held back characters were text after all*/
+			emitData (term, ctx->match, 0);
+			ctx->match = 0;
+		}
+	}
+#undef emitData
+
+	*_ptr = ptr;
+
+	return CX_SUCCESS;
+}
+
+/**
+ * @func   : saxFeed
+ * @brief  : run the streaming decoder state machine over a chunk
+ * @called : by cx_DecFeed for every chunk fed
+ * @input  : cx_saxctx_t *ctx - streaming decoder session
+ *           const char *ptr - first byte of chunk
+ *           const char *end - end of chunk
+ * @output : ctx - state to continue with the next chunk
+ * @return : CX_SUCCESS on success
+ *           non-zero value indicating type of failure
+ *           Every byte is looked at once, except the few bytes of a
+ *           terminator or end tag name already held back in ctx->match
+ */
+static cx_status_t saxFeed (cx_saxctx_t *ctx, const char *ptr, const char *end)
+{
+	cx_status_t xStatus;
+	const char *tPtr, *value;
+	uint32_t tLen, vLen;
+
+	while (ptr < end) {
+		switch (ctx->state) {
+		case SAX_LEAD:
+			tPtr = memchr (ptr, '<', (size_t)(end - ptr));
+			if (!tPtr) {
+				ptr = end;
+				break;
+			}
+			ptr = tPtr + 1;
+			ctx->state = SAX_LT;
+			break;
+
+		case SAX_SPACE:
+			SKIP_SPACES (ptr, end);
+			if (ptr == end) {
+				break;
+			}
+			if (*ptr == '<') {
+				ptr++;
+				ctx->state = SAX_LT;
+			} else {
+				/*we have a content of an element.. no text at top level*/
+				cx_rfail (!ctx->depth, CX_ERR_INVALID_XML);
+				ctx->state = SAX_TEXT;
+			}
+			break;
+
+		case SAX_TEXT:
+			tPtr = memchr (ptr, '<', (size_t)(end - ptr));
+			if (!tPtr) {
+				cx_func_rfail (saxEmit (ctx, content, ptr, \
+							(uint32_t)(end - ptr), 0));
+				ptr = end;
+				break;
+			}
+			cx_func_rfail (saxEmit (ctx, content, ptr, \
+						(uint32_t)(tPtr - ptr), 1));
+			ptr = tPtr + 1;
+			ctx->state = SAX_LT;
+			break;
+
+		case SAX_LT:
+			if (*ptr == '/') {
+				/*should be a tag-closing: </tagName>*/
+				cx_rfail (!ctx->depth, CX_ERR_LONE_TAG);
+				ctx->match = 0;
+				ctx->state = SAX_ETAG;
+				ptr++;
+			} else if (*ptr == '?') {
+				/*Instruction tag, just discard it for now*/
+				ctx->match = 0;
+				ctx->state = SAX_INSTR;
+				ptr++;
+			} else if (*ptr == '!') {
+				ctx->bang = NULL;
+				ctx->match = 0;
+				ctx->state = SAX_BANG;
+				ptr++;
+			} else {
+				cx_rfail ((_cx_CharClass[(uint8_t)*ptr] & \
+							(CX_SCAN_NAME_END | CX_SCAN_NUL)), CX_ERR_INVALID_TAG);
+				cx_rfail ((ctx->depth == CX_SAX_MAX_DEPTH), CX_ERR_DEC_OVERFLOW);
+				ctx->nameOff[ctx->depth] = ctx->names.len;
+				ctx->state = SAX_STAG;
+			}
+			break;
+
+		case SAX_BANG:
+			if (!ctx->bang) {
+				ctx->bang = (*ptr == '-') ? "--" : "[CDATA[";
+			}
+			cx_rfail ((*ptr != ctx->bang[ctx->match]), CX_ERR_INVALID_TAG);
+			ptr++;
+			if (!ctx->bang[++ctx->match]) {
+				ctx->state = (ctx->bang[0] == '-') ? SAX_COMMENT_SP : SAX_CDATA;
+				ctx->match = 0;
+			}
+			break;
+
+		case SAX_STAG:
+			tPtr = findNameEnd (ptr, end);
+			cx_func_rfail (saxAppend (&ctx->names, ptr, (uint32_t)(tPtr - ptr), \
+						ctx->nameOff[ctx->depth] + CX_SAX_MAX_TOKEN_SZ));
+			ptr = tPtr;
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail (!*ptr, CX_ERR_INVALID_XML);
+			ctx->depth++;
+			if (!ctx->seenRoot) {
+				ctx->seenRoot = (ctx->depth == 1);
+			}
+			cx_func_rfail (saxEmit (ctx, startTag, topName (ctx), \
+						topNameLen (ctx)));
+			ctx->state = SAX_IN_TAG;
+			break;
+
+		case SAX_IN_TAG:
+			SKIP_SPACES (ptr, end);
+			if (ptr == end) {
+				break;
+			}
+			if (*ptr == '>') {
+				/*this element might have children/content/both*/
+				ctx->state = SAX_SPACE;
+			} else if (*ptr == '/') {
+				ctx->state = SAX_EMPTY_END;
+			} else {
+				/*name="value" or name='value'*/
+				cx_rfail ((*ptr == '='), CX_ERR_NULL_ATTRNAME);
+				cx_rfail (!*ptr, CX_ERR_INVALID_XML);
+				ctx->tok.len = 0;
+				ctx->state = SAX_ATTR_NAME;
+				break;
+			}
+			ptr++;
+			break;
+
+		case SAX_EMPTY_END:
+			cx_rfail ((*ptr != '>'), CX_ERR_INVALID_TAG);
+			ptr++;
+			cx_func_rfail (saxEmit (ctx, endTag, topName (ctx), \
+						topNameLen (ctx)));
+			ctx->names.len = ctx->nameOff[--ctx->depth];
+			ctx->state = SAX_SPACE;
+			break;
+
+		case SAX_ATTR_NAME:
+			tPtr = findNameEnd (ptr, end);
+			cx_func_rfail (saxAppend (&ctx->tok, ptr, (uint32_t)(tPtr - ptr), \
+						CX_SAX_MAX_TOKEN_SZ));
+			ptr = tPtr;
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail (!*ptr, CX_ERR_INVALID_XML);
+			ctx->attrNameLen = ctx->tok.len;
+			ctx->state = SAX_ATTR_EQ;
+			break;
+
+		case SAX_ATTR_EQ:
+			SKIP_SPACES (ptr, end);
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail ((*ptr != '='), CX_ERR_INVALID_XML);
+			ptr++;
+			ctx->state = SAX_ATTR_QUOTE;
+			break;
+
+		case SAX_ATTR_QUOTE:
+			SKIP_SPACES (ptr, end);
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail (((*ptr != '"') && (*ptr != '\'')), CX_ERR_NULL_ATTRVALUE);
+			ctx->quote = *ptr++;
+			ctx->state = SAX_ATTR_VALUE;
+			break;
+
+		case SAX_ATTR_VALUE:
+			tPtr = memchr (ptr, ctx->quote, (size_t)(end - ptr));
+			tLen = (uint32_t)((tPtr ? tPtr : end) - ptr);
+			if (!tPtr || (ctx->tok.len > ctx->attrNameLen)) {
+				/*value is split over chunks, keep its parts*/
+				cx_func_rfail (saxAppend (&ctx->tok, ptr, tLen, \
+							ctx->attrNameLen + CX_SAX_MAX_TOKEN_SZ));
+			}
+			if (!tPtr) {
+				ptr = end;
+				break;
+			}
+			if (ctx->tok.len > ctx->attrNameLen) {
+				value = ctx->tok.buf + ctx->attrNameLen;
+				vLen = ctx->tok.len - ctx->attrNameLen;
+			} else {
+				/*whole value is in this chunk, no need to copy*/
+				value = ptr;
+				vLen = tLen;
+			}
+			cx_func_rfail (saxEmit (ctx, attr, ctx->tok.buf, ctx->attrNameLen, \
+						value, vLen));
+			ptr = tPtr + 1; /*skip closing quote*/
+			ctx->state = SAX_IN_TAG;
+			break;
+
+		case SAX_ETAG:
+			/*compared in place with name of innermost open element*/
+			tPtr = findNameEnd (ptr, end);
+			tLen = (uint32_t)(tPtr - ptr);
+			cx_rfail (((ctx->match + tLen) > topNameLen (ctx)) || \
+					(CX_SUCCESS != memcmp (topName (ctx) + ctx->match, \
+										   ptr, tLen)), \
+					CX_ERR_CLOSED_TAG_MISMATCH);
+			ctx->match += tLen;
+			ptr = tPtr;
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail ((ctx->match != topNameLen (ctx)), \
+					CX_ERR_CLOSED_TAG_MISMATCH);
+			ctx->state = SAX_ETAG_END;
+			break;
+
+		case SAX_ETAG_END:
+			SKIP_SPACES (ptr, end);
+			if (ptr == end) {
+				break;
+			}
+			cx_rfail ((*ptr != '>'), CX_ERR_UNCLOSED_TAG);
+			ptr++;
+			cx_func_rfail (saxEmit (ctx, endTag, topName (ctx), \
+						topNameLen (ctx)));
+			ctx->names.len = ctx->nameOff[--ctx->depth];
+			ctx->match = 0;
+			ctx->state = SAX_SPACE;
+			break;
+
+		case SAX_COMMENT_SP:
+			SKIP_SPACES (ptr, end);
+			if (ptr < end) {
+				ctx->state = SAX_COMMENT;
+			}
+			break;
+
+		case SAX_COMMENT:
+			cx_func_rfail (saxTermData (ctx, &ptr, end, "-->", ctx->cb.comment));
+			break;
+
+		case SAX_CDATA:
+			cx_func_rfail (saxTermData (ctx, &ptr, end, "]]>", ctx->cb.cdata));
+			break;
+
+		case SAX_INSTR:
+			cx_func_rfail (saxTermData (ctx, &ptr, end, "?>", NULL));
+			break;
+
+		default:
+			return CX_FAILURE;
+		}
+	}
+
+	return CX_SUCCESS;
+}
+
+cx_status_t cx_CreateSaxSession (void **_ctx, char *name, const cx_saxcb_t *cb, void *user)
+{
+	cx_saxctx_t *ctx;
+
+	cx_null_rfail (_ctx);
+	cx_null_rfail (cb);
+
+	_cx_calloc (ctx, sizeof (cx_saxctx_t));
+	cx_alloc_rfail (ctx);
+
+	ctx->cxCode = CX_SAX_MAGIC;
+	strncpy (ctx->name, name ? name : "unknown", CX_COOKIE_NAMELEN - 1);
+	ctx->cb = *cb;
+	ctx->user = user;
+	ctx->state = SAX_LEAD;
+
+	*_ctx = ctx;
+
+	return CX_SUCCESS;
+}
+
+cx_status_t cx_DecFeed (void *_ctx, const char *chunk, uint32_t len)
+{
+	cx_saxctx_t *ctx = (cx_saxctx_t *)_ctx;
+#if CX_USING_STATS
+	cx_stats_t delta = { .bytesScanned = len };
+	uint64_t t0;
+#endif
+
+	cx_null_rfail (ctx);
+	cx_rfail ((ctx->cxCode != CX_SAX_MAGIC), CX_ERR_NULL_PTR);
+	cx_rfail ((ctx->xStatus != CX_SUCCESS), ctx->xStatus);
+	cx_rfail (!chunk && len, CX_ERR_NULL_PTR);
+
+#if CX_USING_STATS
+	t0 = _cx_StatNs ();
+	ctx->xStatus = saxFeed (ctx, chunk, chunk + len);
+	delta.ns[CX_PHASE_DEC] = _cx_StatNs () - t0;
+	/*no tree, no session counters; all of it goes to totals*/
+	_cx_StatsAdd (&delta);
+#else
+	ctx->xStatus = saxFeed (ctx, chunk, chunk + len);
+#endif
+	cx_trace (SAX_FEED, 0, ctx->xStatus, 0, len, ctx->depth);
+	if (ctx->xStatus != CX_SUCCESS) {
+		cx_trace_failed ();
+	}
+	cx_dec_dbg ("%s: fed %u bytes, depth %u, state %u: %s", ctx->name, \
+			len, ctx->depth, ctx->state, cx_strerr (ctx->xStatus));
+
+	return ctx->xStatus;
+}
+
+cx_status_t cx_DecFeedEnd (void *_ctx)
+{
+	cx_saxctx_t *ctx = (cx_saxctx_t *)_ctx;
+
+	cx_null_rfail (ctx);
+	cx_rfail ((ctx->cxCode != CX_SAX_MAGIC), CX_ERR_NULL_PTR);
+	cx_rfail ((ctx->xStatus != CX_SUCCESS), ctx->xStatus);
+	cx_rfail ((ctx->depth || ((ctx->state != SAX_SPACE) && \
+					(ctx->state != SAX_LEAD))), CX_ERR_UNCLOSED_TAG);
+	cx_rfail (!ctx->seenRoot, CX_ERR_INVALID_XML);
+#if CX_USING_STATS
+	_cx_StatsAdd (&(cx_stats_t){ .decodes = 1 });
+#endif
+
+	return CX_SUCCESS;
+}
+
+void cx_DestroySaxSession (void *_ctx)
+{
+	cx_saxctx_t *ctx = (cx_saxctx_t *)_ctx;
+
+	if (!ctx || (ctx->cxCode != CX_SAX_MAGIC)) {
+		return;
+	}
+
+	_cx_free (ctx->names.buf);
+	_cx_free (ctx->tok.buf);
+	ctx->cxCode = 0;
+	free (ctx);
+}
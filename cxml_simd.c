@@ -0,0 +1,191 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_SIMD
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CX_SIMD_X86 1
+#else
+#define CX_SIMD_X86 0
+#endif
+
+#define CX_SCAN_BLK_SZ 64
+
+/*chars a scan compares with, white space class being 4 of them*/
+#define CX_SCAN_MAX_CHARS (CX_SCAN_NCLASS + 3)
+
+/* Blocks are read as a whole from their 64 byte aligned address, which
+ * may be before the string or beyond its end, but never crosses a page.
+ * Address sanitizer doesn't know that, so keep it out of block readers */
+#define CX_BLK_READER __attribute__((no_sanitize_address))
+
+/* A run kernel finds first block from an aligned base having any of given
+ * chars, giving a bitmap of their positions in that block. Bits of the first
+ * block below skip are ignored, they are before the scan start */
+typedef const char *(*cx_scanrun_t) (const char *base, const char *end, \
+		const char *chars, uint32_t nChars, uint64_t skip, uint64_t *mask);
+
+static CX_BLK_READER const char *runScalar (const char *base, const char *end, \
+		const char *chars, uint32_t nChars, uint64_t skip, uint64_t *mask)
+{
+	uint8_t isIn[256] = {0};
+	uint64_t m;
+	uint32_t i;
+
+	for (i = 0; i < nChars; i++) {
+		isIn[(uint8_t)chars[i]] = 1;
+	}
+	for (; base < end; base += CX_SCAN_BLK_SZ, skip = 0) {
+		for (m = 0, i = 0; i < CX_SCAN_BLK_SZ; i++) {
+			m |= (uint64_t)isIn[(uint8_t)base[i]] << i;
+		}
+		if ((*mask = m & ~skip)) {
+			break;
+		}
+	}
+	return base;
+}
+
+#if CX_SIMD_X86 && defined(__SSE2__)
+static CX_BLK_READER const char *runSse2 (const char *base, const char *end, \
+		const char *chars, uint32_t nChars, uint64_t skip, uint64_t *mask)
+{
+	__m128i vc[CX_SCAN_MAX_CHARS];
+	uint64_t m;
+	uint32_t i, j;
+
+	for (i = 0; i < nChars; i++) {
+		vc[i] = _mm_set1_epi8 (chars[i]);
+	}
+	for (; base < end; base += CX_SCAN_BLK_SZ, skip = 0) {
+		for (m = 0, j = 0; j < CX_SCAN_BLK_SZ; j += 16) {
+			__m128i v = _mm_load_si128 ((const __m128i *)(base + j));
+			__m128i acc = _mm_cmpeq_epi8 (v, vc[0]);
+			for (i = 1; i < nChars; i++) {
+				acc = _mm_or_si128 (acc, _mm_cmpeq_epi8 (v, vc[i]));
+			}
+			m |= (uint64_t)(uint16_t)_mm_movemask_epi8 (acc) << j;
+		}
+		if ((*mask = m & ~skip)) {
+			break;
+		}
+	}
+	return base;
+}
+#endif
+
+#if CX_SIMD_X86
+static CX_BLK_READER __attribute__((target ("avx2"))) const char *runAvx2 ( \
+		const char *base, const char *end, const char *chars, uint32_t nChars, \
+		uint64_t skip, uint64_t *mask)
+{
+	__m256i vc[CX_SCAN_MAX_CHARS];
+	uint64_t m;
+	uint32_t i;
+
+	for (i = 0; i < nChars; i++) {
+		vc[i] = _mm256_set1_epi8 (chars[i]);
+	}
+	for (; base < end; base += CX_SCAN_BLK_SZ, skip = 0) {
+		__m256i lo = _mm256_load_si256 ((const __m256i *)base);
+		__m256i hi = _mm256_load_si256 ((const __m256i *)(base + 32));
+		__m256i accLo = _mm256_cmpeq_epi8 (lo, vc[0]);
+		__m256i accHi = _mm256_cmpeq_epi8 (hi, vc[0]);
+		for (i = 1; i < nChars; i++) {
+			accLo = _mm256_or_si256 (accLo, _mm256_cmpeq_epi8 (lo, vc[i]));
+			accHi = _mm256_or_si256 (accHi, _mm256_cmpeq_epi8 (hi, vc[i]));
+		}
+		m = (uint64_t)(uint32_t)_mm256_movemask_epi8 (accLo) | \
+			((uint64_t)(uint32_t)_mm256_movemask_epi8 (accHi) << 32);
+		if ((*mask = m & ~skip)) {
+			break;
+		}
+	}
+	return base;
+}
+#endif
+
+/*Widest run kernel the cpu we run on supports, picked on first use*/
+static cx_scanrun_t scanKernel (void)
+{
+	static cx_scanrun_t kern;
+	cx_scanrun_t k = __atomic_load_n (&kern, __ATOMIC_RELAXED);
+
+	if (!k) {
+		k = runScalar;
+#if CX_SIMD_X86
+		__builtin_cpu_init ();
+#if defined(__SSE2__)
+		if (__builtin_cpu_supports ("sse2")) {
+			k = runSse2;
+		}
+#endif
+		if (__builtin_cpu_supports ("avx2")) {
+			k = runAvx2;
+		}
+#endif
+		__atomic_store_n (&kern, k, __ATOMIC_RELAXED);
+	}
+
+	return k;
+}
+
+/*Character of each class, white space class is ' ' and spaceChars*/
+static const char classChar[CX_SCAN_NCLASS] = {
+	[CX_SCAN_LT_IDX] = '<', [CX_SCAN_GT_IDX] = '>',
+	[CX_SCAN_SLASH_IDX] = '/', [CX_SCAN_EQ_IDX] = '=',
+	[CX_SCAN_QUOT_IDX] = '"', [CX_SCAN_APOS_IDX] = '\'',
+	[CX_SCAN_SPACE_IDX] = ' ', [CX_SCAN_NUL_IDX] = '\0',
+};
+static const char spaceChars[] = { '\t', '\n', '\r' };
+
+/**
+ * @func   : _cx_ScanRun
+ * @brief  : find first character of given classes, comparing 64 bytes of
+ *           the xml string at a time with SSE2/AVX2 kernels
+ * @called : by decoder scans running longer than a few characters, e.g.
+ *           text contents, attr values, comments
+ * @input  : const char *ptr - position to start from
+ *           const char *end - position scanning is not allowed to reach
+ *           uint32_t classes - CX_SCAN_xxx classes to look for
+ * @output : none
+ * @return : position found, end if there is none before it
+ */
+char *_cx_ScanRun (const char *ptr, const char *end, uint32_t classes)
+{
+	const char *base = (const char *)((uintptr_t)ptr & \
+			~(uintptr_t)(CX_SCAN_BLK_SZ - 1));
+	char chars[CX_SCAN_MAX_CHARS];
+	uint32_t c, nChars = 0;
+	uint64_t m;
+
+	for (c = 0; c < CX_SCAN_NCLASS; c++) {
+		if (classes & (1U << c)) {
+			chars[nChars++] = classChar[c];
+		}
+	}
+	if (classes & CX_SCAN_SPACE) {
+		memcpy (chars + nChars, spaceChars, sizeof (spaceChars));
+		nChars += sizeof (spaceChars);
+	}
+	if (!nChars) {
+		return (char *)end;
+	}
+
+	base = scanKernel () (base, end, chars, nChars, \
+			~(~0ULL << (ptr - base)), &m);
+	if (base >= end) {
+		return (char *)end;
+	}
+
+	ptr = base + __builtin_ctzll (m);
+	return (char *)((ptr < end) ? ptr : end);
+}
+
+#endif /*CX_USING_SIMD*/
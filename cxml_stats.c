@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_STATS
+
+/*Counters of cx_stats_t, all uint64_t, walked as an array*/
+#define CX_STATS_N (sizeof (cx_stats_t) / sizeof (uint64_t))
+_Static_assert ((sizeof (cx_stats_t) % sizeof (uint64_t)) == 0, \
+		"cx_stats_t must have only uint64_t counters");
+
+/**
+ * Totals of sessions used by one thread. Only that thread adds to them, so
+ * no read-modify-write has to be atomic; cx_GetStats reads them from any
+ * thread, under cxStats lock so that a block isn't freed meanwhile
+ * next - next thread's block
+ * stats - totals
+ */
+typedef struct cx_statsblk_s {
+	struct cx_statsblk_s *next;
+	cx_stats_t          stats;
+} __attribute__((aligned (64))) cx_statsblk_t;
+
+/**
+ * Process-wide totals
+ * lock - guards blks and retired
+ * key - gets a thread's block folded into retired as the thread exits
+ * blks - blocks of running threads
+ * retired - totals of exited threads, and of threads without a block
+ */
+static struct {
+	pthread_mutex_t     lock;
+	pthread_once_t      once;
+	pthread_key_t       key;
+	int                 keyOk;
+	cx_statsblk_t       *blks;
+	cx_stats_t          retired;
+} cxStats = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+};
+
+static __thread cx_statsblk_t *myBlk;
+
+static inline void statsAddTo (uint64_t *dst, const uint64_t *src)
+{
+	uint32_t i;
+
+	for (i = 0; i < CX_STATS_N; i++) {
+		if (src[i]) {
+			__atomic_store_n (&dst[i], __atomic_load_n (&dst[i], \
+						__ATOMIC_RELAXED) + src[i], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static void statsThreadExit (void *arg)
+{
+	cx_statsblk_t *blk = (cx_statsblk_t *)arg, **pp;
+
+	pthread_mutex_lock (&cxStats.lock);
+	for (pp = &cxStats.blks; *pp && (*pp != blk); pp = &(*pp)->next);
+	if (*pp) {
+		*pp = blk->next;
+	}
+	statsAddTo ((uint64_t *)&cxStats.retired, (uint64_t *)&blk->stats);
+	pthread_mutex_unlock (&cxStats.lock);
+	myBlk = NULL;
+	free (blk);
+}
+
+static void statsKeyInit (void)
+{
+	cxStats.keyOk = !pthread_key_create (&cxStats.key, statsThreadExit);
+}
+
+/*Block of calling thread, set up on its first use; NULL if it can't be*/
+static cx_statsblk_t *statsMyBlk (void)
+{
+	cx_statsblk_t *blk;
+
+	if (myBlk) {
+		return myBlk;
+	}
+	pthread_once (&cxStats.once, statsKeyInit);
+	if (!cxStats.keyOk || !(blk = calloc (1, sizeof (cx_statsblk_t)))) {
+		return NULL;
+	}
+	if (pthread_setspecific (cxStats.key, blk)) {
+		free (blk);
+		return NULL;
+	}
+	pthread_mutex_lock (&cxStats.lock);
+	blk->next = cxStats.blks;
+	cxStats.blks = blk;
+	pthread_mutex_unlock (&cxStats.lock);
+
+	return myBlk = blk;
+}
+
+/**
+ * @func   : _cx_StatsAdd
+ * @brief  : add counters to process-wide totals
+ * @called : by _cx_StatsFlush, and by sessions with no cx_cookie_t
+ * @input  : const cx_stats_t *delta - counters to add
+ * @output : none
+ * @return : void
+ */
+void _cx_StatsAdd (const cx_stats_t *delta)
+{
+	cx_statsblk_t *blk = statsMyBlk ();
+
+	if (blk) {
+		statsAddTo ((uint64_t *)&blk->stats, (const uint64_t *)delta);
+		return;
+	}
+	/*no block of its own, rare enough to go the slow way*/
+	pthread_mutex_lock (&cxStats.lock);
+	statsAddTo ((uint64_t *)&cxStats.retired, (const uint64_t *)delta);
+	pthread_mutex_unlock (&cxStats.lock);
+}
+
+/**
+ * @func   : _cx_StatsFlush
+ * @brief  : add what counters of a session grew by since last flush to
+ *           process-wide totals
+ * @called : at end of decoding, encoding, lookup, reset and destroy of a
+ *           session, by thread using it
+ * @input  : cx_cookie_t *cookie - session
+ * @output : none
+ * @return : void
+ */
+void _cx_StatsFlush (cx_cookie_t *cookie)
+{
+	uint64_t *s = (uint64_t *)&cookie->stats, *f = (uint64_t *)&cookie->flushed;
+	cx_stats_t delta;
+	uint64_t *d = (uint64_t *)&delta;
+	uint32_t i, any = 0;
+
+	for (i = 0; i < CX_STATS_N; i++) {
+		d[i] = s[i] - f[i];
+		any |= (d[i] != 0);
+		f[i] = s[i];
+	}
+	if (any) {
+		_cx_StatsAdd (&delta);
+	}
+}
+
+/**
+ * @func   : _cx_StatsMerge
+ * @brief  : add counters of one session to those of another
+ * @called : when a session's work is done on behalf of another, e.g. chunks
+ *           of a parallel decoding
+ * @input  : const cx_stats_t *src - counters to add
+ * @output : cx_stats_t *dst - counters added to
+ * @return : void
+ */
+void _cx_StatsMerge (cx_stats_t *dst, const cx_stats_t *src)
+{
+	uint64_t *d = (uint64_t *)dst;
+	const uint64_t *s = (const uint64_t *)src;
+	uint32_t i;
+
+	for (i = 0; i < CX_STATS_N; i++) {
+		d[i] += s[i];
+	}
+}
+
+/*Sum in counters which other threads may be adding to*/
+static inline void statsRead (uint64_t *dst, const uint64_t *src)
+{
+	uint32_t i;
+
+	for (i = 0; i < CX_STATS_N; i++) {
+		dst[i] += __atomic_load_n (&src[i], __ATOMIC_RELAXED);
+	}
+}
+
+cx_status_t cx_GetStats (void *_cookie, cx_stats_t *stats)
+{
+	cx_cookie_t *cookie = (cx_cookie_t *)_cookie;
+	cx_statsblk_t *blk;
+
+	cx_null_rfail (stats);
+
+	if (cookie) {
+		cx_rfail ((cookie->cxCode != CX_COOKIE_MAGIC), CX_ERR_NULL_PTR);
+		_cx_StatsFlush (cookie);
+		*stats = cookie->stats;
+		return CX_SUCCESS;
+	}
+
+	memset (stats, 0, sizeof (cx_stats_t));
+	pthread_mutex_lock (&cxStats.lock);
+	statsRead ((uint64_t *)stats, (uint64_t *)&cxStats.retired);
+	for (blk = cxStats.blks; blk; blk = blk->next) {
+		statsRead ((uint64_t *)stats, (uint64_t *)&blk->stats);
+	}
+	pthread_mutex_unlock (&cxStats.lock);
+
+	return CX_SUCCESS;
+}
+
+#endif /*CX_USING_STATS*/
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_SYMTAB
+
+/**
+ * An interned tag/attr name, lives till the process exits
+ * next - next symbol in the same hash bucket
+ * hash - hash of the name
+ * id - symbol ID, never 0
+ * len - number of characters in name
+ * name - the name, NULL terminated
+ */
+typedef struct cx_sym_s {
+	struct cx_sym_s     *next;
+	uint32_t            hash;
+	uint32_t            id;
+	uint32_t            len;
+	char                name[];
+} cx_sym_t;
+
+/*Buckets of a shard, table never grows beyond CX_SYM_MAX symbols*/
+#define CX_SYM_BUCKETS \
+	(((CX_SYM_MAX / CX_SYM_SHARDS) > 16) ? (CX_SYM_MAX / CX_SYM_SHARDS) : 16)
+
+/**
+ * Symbols whose hash selects this shard. Readers walk the buckets without
+ * any lock: a symbol is fully written before it is published at head of
+ * its bucket and is never changed or freed after that. Only writers of a
+ * shard take its lock, so interning different names rarely contends
+ * lock - serialises insertions into this shard
+ * bucket - chains of symbols, hash bits above shard bits pick a bucket
+ */
+typedef struct cx_symshard_s {
+	pthread_mutex_t     lock;
+	cx_sym_t            *bucket[CX_SYM_BUCKETS];
+} __attribute__((aligned (64))) cx_symshard_t;
+
+static cx_symshard_t symShard[CX_SYM_SHARDS] = {
+	[0 ... (CX_SYM_SHARDS - 1)] = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+/*Number of IDs handed out, once it is CX_SYM_MAX the table is full*/
+static uint32_t symCount;
+
+/*Same hash as the tag index, so both stay cheap for short names*/
+static inline uint32_t symHash (const char *name, uint32_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h = (h ^ (uint8_t)*name++) * 16777619u;
+	}
+	return h;
+}
+
+#define SYM_SHARD(hash) (&symShard[(hash) % CX_SYM_SHARDS])
+#define SYM_BUCKET(shard, hash) \
+	(&(shard)->bucket[((hash) / CX_SYM_SHARDS) % CX_SYM_BUCKETS])
+
+static cx_sym_t *symLookup (cx_sym_t **bucket, const char *name, \
+		uint32_t len, uint32_t hash)
+{
+	cx_sym_t *sym = __atomic_load_n (bucket, __ATOMIC_ACQUIRE);
+
+	for (; sym; sym = sym->next) {
+		if ((sym->hash == hash) && (sym->len == len) && \
+				!memcmp (sym->name, name, len)) {
+			break;
+		}
+	}
+	return sym;
+}
+
+/**
+ * @func   : _cx_SymFind
+ * @brief  : find ID of an already interned name, without interning it
+ * @called : to turn a user given name into an ID for comparisons
+ * @input  : const char *name - name, need not be NULL terminated
+ *           uint32_t len - number of characters in name
+ * @output : none
+ * @return : ID of name, 0 if it isn't interned
+ */
+uint32_t _cx_SymFind (const char *name, uint32_t len)
+{
+	uint32_t hash = symHash (name, len);
+	cx_sym_t *sym = symLookup (SYM_BUCKET (SYM_SHARD (hash), hash), \
+			name, len, hash);
+
+	return sym ? sym->id : 0;
+}
+
+/**
+ * @func   : _cx_SymIntern
+ * @brief  : give the shared copy and ID of a tag/attr name, adding it to
+ *           the global symbol table if it's not there yet
+ * @called : for every tag/attr name added to a tree by encoder or decoder
+ * @input  : const char *name - name, need not be NULL terminated
+ *           uint32_t len - number of characters in name
+ * @output : const char **symName - shared NULL terminated copy of name
+ * @return : ID of name, 0 if name can't be interned, i.e. it's longer than
+ *           CX_SYM_MAX_LEN, table is full or out of memory; caller then
+ *           keeps a copy of its own and compares by characters
+ */
+uint32_t _cx_SymIntern (const char *name, uint32_t len, const char **symName)
+{
+	uint32_t hash, id;
+	cx_symshard_t *shard;
+	cx_sym_t **bucket, *sym;
+
+	if (!len || (len > CX_SYM_MAX_LEN)) {
+		return 0;
+	}
+
+	hash = symHash (name, len);
+	shard = SYM_SHARD (hash);
+	bucket = SYM_BUCKET (shard, hash);
+
+	/*Mostly the vocabulary is already there, no lock needed for that*/
+	sym = symLookup (bucket, name, len, hash);
+	if (sym) {
+		*symName = sym->name;
+		return sym->id;
+	}
+	if (__atomic_load_n (&symCount, __ATOMIC_RELAXED) >= CX_SYM_MAX) {
+		return 0;
+	}
+
+	pthread_mutex_lock (&shard->lock);
+	/*someone might have added it meanwhile*/
+	sym = symLookup (bucket, name, len, hash);
+	if (!sym) {
+		id = __atomic_add_fetch (&symCount, 1, __ATOMIC_RELAXED);
+		if (id <= CX_SYM_MAX) {
+			sym = malloc (sizeof (cx_sym_t) + len + 1);
+		}
+		if (sym) {
+			sym->hash = hash;
+			sym->id = id;
+			sym->len = len;
+			memcpy (sym->name, name, len);
+			sym->name[len] = '\0';
+			sym->next = *bucket;
+			__atomic_store_n (bucket, sym, __ATOMIC_RELEASE);
+		}
+		/*if full or out of memory, the ID is just left unused*/
+	}
+	pthread_mutex_unlock (&shard->lock);
+
+	if (!sym) {
+		return 0;
+	}
+	*symName = sym->name;
+	return sym->id;
+}
+
+#endif /*CX_USING_SYMTAB*/
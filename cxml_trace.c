@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+#if CX_USING_TRACE
+
+_Static_assert (!(CX_TRACE_RING_SZ & (CX_TRACE_RING_SZ - 1)), \
+		"CX_TRACE_RING_SZ must be a power of 2");
+
+/**
+ * Last events of a thread. Only its thread writes it, without any lock: a
+ * record is stored first and then head is bumped with release order, so
+ * a dump can copy the ring as it is being written and drop what got
+ * overwritten meanwhile
+ * next - ring of another thread
+ * head - events recorded ever, next one goes at head % CX_TRACE_RING_SZ
+ * tid - kernel thread ID of the thread
+ */
+typedef struct cx_tracering_s {
+	struct cx_tracering_s *next;
+	uint64_t            head;
+	uint32_t            tid;
+	cx_tracerec_t       rec[CX_TRACE_RING_SZ];
+} __attribute__((aligned (64))) cx_tracering_t;
+
+int _cx_TraceOn;
+
+/**
+ * lock - guards rings, and serialises dumps
+ * key - frees a thread's ring as the thread exits
+ * rings - rings of running threads which traced something
+ * errFd - where rings go when a call fails, -1 for nowhere
+ * ts0, ns0 - ticks and ns when tracing was turned on
+ */
+static struct {
+	pthread_mutex_t     lock;
+	pthread_once_t      once;
+	pthread_key_t       key;
+	int                 keyOk;
+	cx_tracering_t      *rings;
+	int                 errFd;
+	uint64_t            ts0;
+	uint64_t            ns0;
+} cxTrace = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+	.errFd = -1,
+};
+
+static __thread cx_tracering_t *myRing;
+
+/*Ticks of records, TSC where there is one as it is cheapest to read*/
+static inline uint64_t traceTicks (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc ();
+#else
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+#endif
+}
+
+static inline uint64_t traceNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+static void traceThreadExit (void *arg)
+{
+	cx_tracering_t *ring = (cx_tracering_t *)arg, **pp;
+
+	pthread_mutex_lock (&cxTrace.lock);
+	for (pp = &cxTrace.rings; *pp && (*pp != ring); pp = &(*pp)->next);
+	if (*pp) {
+		*pp = ring->next;
+	}
+	pthread_mutex_unlock (&cxTrace.lock);
+	myRing = NULL;
+	free (ring);
+}
+
+static void traceKeyInit (void)
+{
+	cxTrace.keyOk = !pthread_key_create (&cxTrace.key, traceThreadExit);
+}
+
+/*Ring of calling thread, set up on its first event; NULL if it can't be*/
+static cx_tracering_t *traceMyRing (void)
+{
+	cx_tracering_t *ring;
+
+	pthread_once (&cxTrace.once, traceKeyInit);
+	if (!cxTrace.keyOk || !(ring = calloc (1, sizeof (cx_tracering_t)))) {
+		return NULL;
+	}
+	if (pthread_setspecific (cxTrace.key, ring)) {
+		free (ring);
+		return NULL;
+	}
+	ring->tid = (uint32_t)syscall (SYS_gettid);
+	pthread_mutex_lock (&cxTrace.lock);
+	ring->next = cxTrace.rings;
+	cxTrace.rings = ring;
+	pthread_mutex_unlock (&cxTrace.lock);
+
+	return myRing = ring;
+}
+
+/**
+ * @func   : _cx_TraceRec
+ * @brief  : record an event in trace ring of calling thread
+ * @called : through cx_trace, only while tracing is on
+ * @input  : uint32_t ev - cx_tev_t
+ *           uint32_t type, status, off, len, aux - as the event defines
+ *           them in CX_TRACE_EVENTS, 0 if unused
+ * @output : none
+ * @return : void
+ */
+void _cx_TraceRec (uint32_t ev, uint32_t type, uint32_t status, \
+		uint32_t off, uint32_t len, uint32_t aux)
+{
+	cx_tracering_t *ring = myRing;
+	cx_tracerec_t *rec;
+	uint64_t head;
+
+	if (!ring && !(ring = traceMyRing ())) {
+		return;
+	}
+	head = ring->head;
+	rec = &ring->rec[head & (CX_TRACE_RING_SZ - 1)];
+	/*a dump seeing any of these stores sees head of earlier events too*/
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	__atomic_store_n (&rec->ts, traceTicks (), __ATOMIC_RELAXED);
+	__atomic_store_n (&rec->info, (uint64_t)(ev & 0xFFFF) | \
+			((uint64_t)(type & 0xFF) << 16) | \
+			((uint64_t)(status & 0xFF) << 24) | ((uint64_t)aux << 32), \
+			__ATOMIC_RELAXED);
+	__atomic_store_n (&rec->arg, (uint64_t)off | ((uint64_t)len << 32), \
+			__ATOMIC_RELAXED);
+	__atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*Write all of buf, going on after short writes*/
+static int traceWrite (int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	ssize_t n;
+
+	while (len) {
+		n = write (fd, p, len);
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/*Copy events of a ring still there after the copy, oldest first*/
+static uint32_t traceCopy (cx_tracering_t *ring, cx_tracerec_t *out, \
+		uint64_t *dropped)
+{
+	uint64_t h1, h2, first, i;
+	cx_tracerec_t *rec;
+	uint32_t n = 0;
+
+	h1 = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+	first = (h1 > CX_TRACE_RING_SZ) ? (h1 - CX_TRACE_RING_SZ) : 0;
+	for (i = first; i < h1; i++) {
+		rec = &ring->rec[i & (CX_TRACE_RING_SZ - 1)];
+		out[i - first].ts = __atomic_load_n (&rec->ts, __ATOMIC_RELAXED);
+		out[i - first].info = __atomic_load_n (&rec->info, __ATOMIC_RELAXED);
+		out[i - first].arg = __atomic_load_n (&rec->arg, __ATOMIC_RELAXED);
+	}
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	/*slots of events from h2 - SZ on, one being written included, may
+	 *have been reused while they were copied*/
+	h2 = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+	if ((h2 + 1) > (first + CX_TRACE_RING_SZ)) {
+		n = (uint32_t)(((h2 + 1 - CX_TRACE_RING_SZ) < h1) ? \
+				(h2 + 1 - CX_TRACE_RING_SZ - first) : (h1 - first));
+		memmove (out, out + n, (size_t)(h1 - first - n) * sizeof (*out));
+	}
+	*dropped = first + n;
+
+	return (uint32_t)(h1 - first - n);
+}
+
+/*Dump rings, cxTrace lock held*/
+static cx_status_t traceDump (int fd)
+{
+	cx_tracehdr_t hdr = {
+		.magic = CX_TRACE_MAGIC,
+		.version = 1,
+		.recSz = sizeof (cx_tracerec_t),
+		.ts0 = cxTrace.ts0,
+		.ns0 = cxTrace.ns0,
+	};
+	cx_traceringhdr_t rh;
+	cx_tracerec_t *buf;
+	cx_tracering_t *ring;
+	cx_status_t xStatus = CX_SUCCESS;
+
+	buf = malloc (CX_TRACE_RING_SZ * sizeof (cx_tracerec_t));
+	cx_alloc_rfail (buf);
+
+	for (ring = cxTrace.rings; ring; ring = ring->next) {
+		hdr.nRings++;
+	}
+	hdr.ts1 = traceTicks ();
+	hdr.ns1 = traceNs ();
+	cx_lfail (traceWrite (fd, &hdr, sizeof (hdr)), CX_FAILURE);
+
+	for (ring = cxTrace.rings; ring; ring = ring->next) {
+		rh.tid = ring->tid;
+		rh.nRecs = traceCopy (ring, buf, &rh.dropped);
+		cx_lfail (traceWrite (fd, &rh, sizeof (rh)) || \
+				traceWrite (fd, buf, rh.nRecs * sizeof (cx_tracerec_t)), \
+				CX_FAILURE);
+	}
+
+CX_ERR_LBL:
+	free (buf);
+
+	return xStatus;
+}
+
+/**
+ * @func   : _cx_TraceFailed
+ * @brief  : dump rings to the fd given to cx_TraceDumpOnError, if any
+ * @called : through cx_trace_failed, as a decoding/encoding call fails
+ * @input  : none
+ * @output : none
+ * @return : void
+ */
+void _cx_TraceFailed (void)
+{
+	pthread_mutex_lock (&cxTrace.lock);
+	if (cxTrace.errFd >= 0) {
+		traceDump (cxTrace.errFd);
+	}
+	pthread_mutex_unlock (&cxTrace.lock);
+}
+
+void cx_TraceEnable (int on)
+{
+	pthread_mutex_lock (&cxTrace.lock);
+	if (on && !_cx_TraceOn) {
+		cxTrace.ts0 = traceTicks ();
+		cxTrace.ns0 = traceNs ();
+	}
+	__atomic_store_n (&_cx_TraceOn, !!on, __ATOMIC_RELAXED);
+	pthread_mutex_unlock (&cxTrace.lock);
+}
+
+cx_status_t cx_TraceDump (int fd)
+{
+	cx_status_t xStatus;
+
+	cx_rfail ((fd < 0), CX_ERR_NULL_PTR);
+
+	pthread_mutex_lock (&cxTrace.lock);
+	xStatus = traceDump (fd);
+	pthread_mutex_unlock (&cxTrace.lock);
+
+	return xStatus;
+}
+
+void cx_TraceDumpOnError (int fd)
+{
+	pthread_mutex_lock (&cxTrace.lock);
+	cxTrace.errFd = fd;
+	pthread_mutex_unlock (&cxTrace.lock);
+}
+
+#endif /*CX_USING_TRACE*/
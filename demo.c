@@ -15,7 +15,8 @@ int encode_data_in_xml (void)
 	char *ptr_xmlBuf = xmlBuf;
 
 	cxa_func_lfail (cx_CreateSession (&encCookie, "CXML_DEMO_ENCODE", \
-				ptr_xmlBuf, 0), ret, -1, "XML encoder session creation");
+				ptr_xmlBuf, sizeof (xmlBuf)), ret, -1, \
+			"XML encoder session creation");
 	cxa_func_lfail (cx_AddFirstNode (encCookie, "x", CXN_PARENT), ret, -2, \
 			"add first node: x");
 	cxa_func_lfail (cx_AddAttr_STR (encCookie, "xmlns:xinclude", \
@@ -42,7 +43,8 @@ int encode_data_in_xml (void)
 
 	cxa_func_lfail (cx_EncPkt (encCookie, NULL), ret, -111, "Encoding failed");
 
-	printf ("SUCCESS!!!! Encoded xml packet:\n%s\n", ptr_xmlBuf);
+	printf ("SUCCESS!!!! Encoded xml packet (%llu bytes):\n%s\n", \
+			(unsigned long long)cx_EncLength (encCookie), ptr_xmlBuf);
 
 CXA_ERR_LBL:
 	if (xStatus != CX_SUCCESS) {
@@ -71,13 +73,74 @@ int decode_data_in_xml (void)
 	return ret;
 }
 
+static cx_status_t sax_start (void *user, const char *tag, uint32_t tagLen)
+{
+	printf ("<%.*s>\n", tagLen, tag);
+	return CX_SUCCESS;
+}
+
+static cx_status_t sax_attr (void *user, const char *name, uint32_t nameLen, \
+		const char *value, uint32_t valueLen)
+{
+	printf ("  %.*s = \"%.*s\"\n", nameLen, name, valueLen, value);
+	return CX_SUCCESS;
+}
+
+static cx_status_t sax_end (void *user, const char *tag, uint32_t tagLen)
+{
+	printf ("</%.*s>\n", tagLen, tag);
+	return CX_SUCCESS;
+}
+
+static cx_status_t sax_text (void *user, const char *data, uint32_t len, int isLast)
+{
+	/*text may come in pieces, as it is fed*/
+	printf ("%.*s%s", len, data, isLast ? "\n" : "");
+	return CX_SUCCESS;
+}
+
+int sax_decode_data_in_xml (void)
+{
+	int ret = 0;
+	cx_status_t xStatus = CX_SUCCESS;
+	cx_saxcb_t cb = {
+		.startTag = sax_start,
+		.attr = sax_attr,
+		.endTag = sax_end,
+		.content = sax_text,
+		.comment = sax_text,
+	};
+	void *saxCtx = NULL;
+	uint32_t len = strlen (xmlBuf), i;
+
+	cxa_func_lfail ((xStatus = cx_CreateSaxSession (&saxCtx, "CXML_DEMO_SAX", \
+					&cb, NULL)), ret, -1, "SAX decoder session creation");
+	/*feed in small pieces, as if they arrive from network*/
+	for (i = 0; i < len; i += 7) {
+		cxa_func_lfail ((xStatus = cx_DecFeed (saxCtx, xmlBuf + i, \
+						((len - i) < 7) ? (len - i) : 7)), ret, -2, "SAX feed");
+	}
+	cxa_func_lfail ((xStatus = cx_DecFeedEnd (saxCtx)), ret, -3, \
+			"SAX feed end");
+
+	printf ("Stream Decoding Success!\n");
+
+CXA_ERR_LBL:
+	if (ret) {
+		printf ("%s\n", cx_strerr (xStatus));
+	}
+	cx_DestroySaxSession (saxCtx);
+
+	return ret;
+}
+
 int main (int argc, char **argv)
 {
 	int ret = 0;
 	char choice;
 
 	if (!argv[1]) {
-		printf ("Usage: ./a.out <e|d>\n");
+		printf ("Usage: ./a.out <e|d|s>\n");
 		return -1;
 	}
 
@@ -92,12 +155,16 @@ int main (int argc, char **argv)
 				ret = decode_data_in_xml ();
 				if (ret) goto END;
 				break;
+			case 's':
+				ret = sax_decode_data_in_xml ();
+				if (ret) goto END;
+				break;
 			case 'x':
 			case 'q':
 				printf ("Exiting..\n");
 				goto END;
 		}
-		printf ("e|d: ");
+		printf ("e|d|s: ");
 		scanf (" %c", &choice);
 	}
 
@@ -0,0 +1,157 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cxml.h"
+#include "cxml_api.h"
+#include "cxml_errchk.h"
+
+/* Renders a dump of cx_TraceDump/cx_TraceDumpOnError as text, a line per
+ * event: time in us since tracing was turned on, thread, event and its
+ * arguments.
+ * Usage: cxml_tracedec [-m] [dumpFile]
+ * -m merges events of all threads in time order, else they go thread by
+ * thread; dump is read from stdin without dumpFile. A file with several
+ * dumps back to back, as left by cx_TraceDumpOnError, has them all
+ * rendered one after another */
+
+#define TEV_NAME(name) #name,
+static const char *evName[CX_TEV_MAX] = {
+	CX_TRACE_EVENTS (TEV_NAME)
+};
+
+static const char *typeName[CXN_MAX] = {
+	[CXN_PARENT] = "parent", [CXN_SINGLE] = "single",
+	[CXN_COMMENT] = "comment", [CXN_INSTR] = "instr",
+	[CXN_CDATA] = "cdata", [CXN_CONTENT] = "content",
+};
+
+/*A record along with its thread, as events are rendered*/
+typedef struct tev_s {
+	cx_tracerec_t       rec;
+	uint32_t            tid;
+} tev_t;
+
+static int byTime (const void *a, const void *b)
+{
+	const tev_t *x = (const tev_t *)a, *y = (const tev_t *)b;
+
+	return (x->rec.ts > y->rec.ts) - (x->rec.ts < y->rec.ts);
+}
+
+static void render (const cx_tracehdr_t *hdr, const tev_t *ev)
+{
+	uint32_t id = (uint32_t)(ev->rec.info & 0xFFFF);
+	uint32_t type = (uint32_t)((ev->rec.info >> 16) & 0xFF);
+	uint32_t status = (uint32_t)((ev->rec.info >> 24) & 0xFF);
+	uint32_t aux = (uint32_t)(ev->rec.info >> 32);
+	uint32_t off = (uint32_t)ev->rec.arg, len = (uint32_t)(ev->rec.arg >> 32);
+	double nsPerTick = (hdr->ts1 > hdr->ts0) ? \
+		((double)(hdr->ns1 - hdr->ns0) / (hdr->ts1 - hdr->ts0)) : 1.0;
+	double us = ((double)(int64_t)(ev->rec.ts - hdr->ts0) * nsPerTick) / 1e3;
+
+	printf ("%14.3f %7u %-12s", us, ev->tid, \
+			(id < CX_TEV_MAX) ? evName[id] : "?");
+	if (id == CX_TEV_DEC_NODE) {
+		printf (" %-8s", (type < CXN_MAX) ? typeName[type] : "?");
+	}
+	printf (" off=%u len=%u aux=%u", off, len, aux);
+	if (status) {
+		printf (" status=%s", cx_strerr ((cx_status_t)status));
+	}
+	printf ("\n");
+}
+
+/*Render one dump, 0 if it's done, 1 at end of file, -1 if it's broken*/
+static int decodeDump (FILE *fp, int merge)
+{
+	cx_tracehdr_t hdr;
+	cx_traceringhdr_t rh;
+	tev_t *ev = NULL, *more;
+	size_t nEv = 0, cap = 0, i, base;
+	uint32_t r, k;
+
+	if (fread (&hdr, sizeof (hdr), 1, fp) != 1) {
+		return 1;
+	}
+	if ((hdr.magic != CX_TRACE_MAGIC) || (hdr.version != 1) || \
+			(hdr.recSz != sizeof (cx_tracerec_t))) {
+		fprintf (stderr, "not a trace dump, or of another version\n");
+		return -1;
+	}
+
+	printf ("# dump at %.3f us, %u threads\n", \
+			(double)(hdr.ns1 - hdr.ns0) / 1e3, hdr.nRings);
+	for (r = 0; r < hdr.nRings; r++) {
+		if ((fread (&rh, sizeof (rh), 1, fp) != 1) || \
+				(rh.nRecs > CX_TRACE_RING_SZ)) {
+			fprintf (stderr, "dump is cut short\n");
+			free (ev);
+			return -1;
+		}
+		printf ("# thread %u: %u events, %llu older ones overwritten\n", \
+				rh.tid, rh.nRecs, (unsigned long long)rh.dropped);
+		if ((nEv + rh.nRecs) > cap) {
+			cap = (nEv + rh.nRecs) * 2;
+			more = realloc (ev, cap * sizeof (tev_t));
+			if (!more) {
+				free (ev);
+				return -1;
+			}
+			ev = more;
+		}
+		base = nEv;
+		for (k = 0; k < rh.nRecs; k++, nEv++) {
+			if (fread (&ev[nEv].rec, sizeof (cx_tracerec_t), 1, fp) != 1) {
+				fprintf (stderr, "dump is cut short\n");
+				free (ev);
+				return -1;
+			}
+			ev[nEv].tid = rh.tid;
+		}
+		if (!merge) {
+			for (i = base; i < nEv; i++) {
+				render (&hdr, &ev[i]);
+			}
+		}
+	}
+	if (merge) {
+		qsort (ev, nEv, sizeof (tev_t), byTime);
+		for (i = 0; i < nEv; i++) {
+			render (&hdr, &ev[i]);
+		}
+	}
+	free (ev);
+
+	return 0;
+}
+
+int main (int argc, char *argv[])
+{
+	FILE *fp = stdin;
+	int opt, merge = 0, ret, nDumps = 0;
+
+	while ((opt = getopt (argc, argv, "m")) != -1) {
+		switch (opt) {
+			case 'm': merge = 1; break;
+			default:
+				fprintf (stderr, "usage: %s [-m] [dumpFile]\n", argv[0]);
+				return 1;
+		}
+	}
+	if ((optind < argc) && !(fp = fopen (argv[optind], "rb"))) {
+		perror (argv[optind]);
+		return 1;
+	}
+
+	while (!(ret = decodeDump (fp, merge))) {
+		nDumps++;
+	}
+	if (fp != stdin) {
+		fclose (fp);
+	}
+
+	return ((ret < 0) || !nDumps) ? 1 : 0;
+}